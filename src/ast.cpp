@@ -2,7 +2,29 @@
 
 namespace draft {
 
-Literal::Literal(object::Object value)
+namespace {
+
+// Whether any of the nodes, which may be null, suspends
+template <typename... Nodes>
+bool anySuspends(const Nodes *...nodes)
+{
+    return ((nodes and nodes->suspends) or ...);
+}
+
+template <typename Node>
+bool anySuspends(const std::vector<Node *> &nodes)
+{
+    for (const Node *node : nodes) {
+        if (anySuspends(node)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace
+
+Literal::Literal(object::Value value)
     : value{value}
 {
 }
@@ -12,25 +34,28 @@ Logical::Logical(Expr *left, Token op, Expr *right)
     , op{op}
     , right{right}
 {
+    suspends = anySuspends(left, right);
 }
 
 Unary::Unary(Token op, Expr *right)
     : op{std::move(op)}
     , right{right}
 {
+    suspends = anySuspends(right);
 }
 
 Binary::Binary(Expr *left, Token op, Expr *right)
     : left{left}
     , op{std::move(op)}
     , right{right}
-
 {
+    suspends = anySuspends(left, right);
 }
 
 Grouping::Grouping(Expr *expr)
     : expression{expr}
 {
+    suspends = anySuspends(expression);
 }
 
 Variable::Variable(Token name)
@@ -42,11 +67,13 @@ Assign::Assign(Token name, Expr *value)
     : name{name}
     , value{value}
 {
+    suspends = anySuspends(value);
 }
 
 ExprStmt::ExprStmt(Expr *expr)
     : expression{expr}
 {
+    suspends = anySuspends(expression);
 }
 
 If::If(Expr *condition, Stmt *thenBranch, Stmt *elseBranch)
@@ -54,28 +81,33 @@ If::If(Expr *condition, Stmt *thenBranch, Stmt *elseBranch)
     , thenBranch{thenBranch}
     , elseBranch{elseBranch}
 {
+    suspends = anySuspends(condition, thenBranch, elseBranch);
 }
 
 Print::Print(Expr *expr)
     : expression{expr}
 {
+    suspends = anySuspends(expression);
 }
 
 While::While(Expr *condition, Stmt *body)
     : condition{condition}
     , body{body}
 {
+    suspends = anySuspends(condition, body);
 }
 
 Var::Var(Token name, Expr *initializer)
     : name{name}
     , initializer{initializer}
 {
+    suspends = anySuspends(initializer);
 }
 
 Block::Block(const std::vector<Stmt *> &statements)
     : statements{statements}
 {
+    suspends = anySuspends(statements);
 }
 
 Class::Class(Token name, Variable *superclass, std::vector<FuncStmt *> methods)
@@ -90,6 +122,9 @@ Call::Call(Expr *callee, Token paren, std::vector<Expr *> arguments)
     , paren{paren}
     , arguments{arguments}
 {
+    // Runs a call
+    suspends = true;
+    ready = !anySuspends(callee) and !anySuspends(arguments);
 }
 
 FuncStmt::FuncStmt(Token name, std::vector<Token> params, std::vector<Stmt *> body)
@@ -103,12 +138,15 @@ Return::Return(Token keyword, Expr *value)
     : keyword{keyword}
     , value{value}
 {
+    // Leaves the call it is in
+    suspends = true;
 }
 
 Get::Get(Expr *object, Token name)
     : object{object}
     , name{name}
 {
+    suspends = anySuspends(object);
 }
 
 Set::Set(Expr *object, Token name, Expr *value)
@@ -116,6 +154,7 @@ Set::Set(Expr *object, Token name, Expr *value)
     , name{name}
     , value{value}
 {
+    suspends = anySuspends(object, value);
 }
 
 Super::Super(Token keyword, Token method)
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "arena.h"
+#include "inline_cache.h"
 #include "object.h"
 #include "token.h"
 
@@ -31,6 +32,26 @@ class Block;
 class Class;
 class Var;
 
+// Where the Resolver found a variable. Locals of the running function are in a slot of its frame;
+// the slot holds a cell instead of the value if a closure captures the variable. Variables of
+// enclosing functions are reached through the closure, slot is then the index of the upvalue.
+// Globals are left unresolved
+struct Location {
+    enum class Kind : std::uint8_t { Global, Local, Cell, Upvalue };
+
+    Kind kind = Kind::Global;
+    int slot = -1;
+};
+
+// A variable a closure captures when it is made: the cell in a slot of the frame it is declared
+// in, or if it is not a local of the enclosing function, the upvalue at index slot of that function
+struct Capture {
+    bool isLocal = true;
+    int slot = -1;
+
+    bool operator==(const Capture &) const = default;
+};
+
 template <typename T>
 class IExprVisitor {
 public:
@@ -51,31 +72,62 @@ public:
 
 class Expr : public memory::Object {
 public:
+    // Which node the expression is, so that an evaluator can switch on it instead of visiting
+    enum class Kind : std::uint8_t {
+        Literal,
+        Logical,
+        Unary,
+        Binary,
+        Call,
+        Grouping,
+        Variable,
+        Assign,
+        Get,
+        Set,
+        Super,
+        This,
+    };
+
+    explicit Expr(Kind kind)
+        : kind{kind}
+    {
+    }
+
     virtual std::string accept(IExprVisitor<std::string> *visitor) = 0;
-    virtual object::Object accept(IExprVisitor<object::Object> *visitor) = 0;
+    virtual object::Value accept(IExprVisitor<object::Value> *visitor) = 0;
+
+    const Kind kind;
+    // Whether evaluating the expression may run a call. The tree-walker has to be able to suspend
+    // such nodes, the others it evaluates right away
+    bool suspends = false;
 };
 
-template <typename T>
+template <typename T, Expr::Kind K>
 class ExprBase : public Expr {
 public:
+    ExprBase()
+        : Expr{K}
+    {
+    }
+
     std::string accept(IExprVisitor<std::string> *visitor) override
     {
         return visitor->visit(static_cast<T *>(this));
     }
-    object::Object accept(IExprVisitor<object::Object> *visitor) override
+    object::Value accept(IExprVisitor<object::Value> *visitor) override
     {
         return visitor->visit(static_cast<T *>(this));
     }
 };
 
-class Literal : public ExprBase<Literal> {
+class Literal : public ExprBase<Literal, Expr::Kind::Literal> {
 public:
-    explicit Literal(object::Object value);
+    explicit Literal(object::Value value);
 
-    object::Object value;
+    object::Value value;
 };
 
-class Logical : public ExprBase<Logical> {
+class Logical : public ExprBase<Logical, Expr::Kind::Logical> {
 public:
     Logical(Expr *left, Token op, Expr *right);
 
@@ -84,7 +136,7 @@ public:
     Expr *right = nullptr;
 };
 
-class Unary : public ExprBase<Unary> {
+class Unary : public ExprBase<Unary, Expr::Kind::Unary> {
 public:
     Unary(Token op, Expr *right);
 
@@ -92,73 +144,118 @@ public:
     Expr *right = nullptr;
 };
 
-class Binary : public ExprBase<Binary> {
+class Binary : public ExprBase<Binary, Expr::Kind::Binary> {
 public:
+    // What the tree-walker has rewritten the node into. It starts uninitialized, turns into one of
+    // the number operations once it has seen two numbers and guards on them from then on. Any
+    // other operands make it generic for good
+    enum class Specialization : std::uint8_t {
+        Uninitialized,
+        NumberAdd,
+        NumberSubtract,
+        NumberMultiply,
+        NumberDivide,
+        NumberGreater,
+        NumberGreaterEqual,
+        NumberLess,
+        NumberLessEqual,
+        NumberEqual,
+        NumberNotEqual,
+        Generic,
+    };
+
     Binary(Expr *left, Token op, Expr *right);
 
     Expr *left = nullptr;
     Token op;
     Expr *right = nullptr;
+    Specialization specialization = Specialization::Uninitialized;
 };
 
-class Call : public ExprBase<Call> {
+class Call : public ExprBase<Call, Expr::Kind::Call> {
 public:
+    // A call site that has only called functions of one declaration calls them directly, its
+    // arity was checked on the first call. Any other callee makes it generic for good
+    enum class Specialization : std::uint8_t { Uninitialized, Function, Generic };
+
     Call(Expr *callee, Token paren, std::vector<Expr *> arguments);
     Expr *callee = nullptr;
     Token paren;
     std::vector<Expr *> arguments;
+    object::InlineCache cache;
+    Specialization specialization = Specialization::Uninitialized;
+    FuncStmt *target = nullptr;  // declaration the Function specialization guards on
+    // The value of a return, so the callee can take over the caller's frame. Set by the Resolver
+    bool tail = false;
+    // Neither the callee nor the arguments run calls, the call is made as soon as it begins
+    bool ready = false;
 };
 
-class Grouping : public ExprBase<Grouping> {
+class Grouping : public ExprBase<Grouping, Expr::Kind::Grouping> {
 public:
     explicit Grouping(Expr *expr);
 
     Expr *expression = nullptr;
 };
 
-class Variable : public ExprBase<Variable> {
+class Variable : public ExprBase<Variable, Expr::Kind::Variable> {
 public:
     explicit Variable(Token name);
 
-    Token name;
+    Name name;
+    Location location;
 };
 
-class Assign : public ExprBase<Assign> {
+class Assign : public ExprBase<Assign, Expr::Kind::Assign> {
 public:
     Assign(Token name, Expr *value);
 
-    Token name;
+    Name name;
     Expr *value = nullptr;
+    Location location;
 };
 
-class Get : public ExprBase<Get> {
+class Get : public ExprBase<Get, Expr::Kind::Get> {
 public:
+    // A site that has read a field of instances of a single shape loads it directly, guarded by
+    // the shape. Anything else makes it generic for good, leaving the inline cache to it
+    enum class Specialization : std::uint8_t { Uninitialized, Field, Generic };
+
     Get(Expr *object, Token name);
 
     Expr *object = nullptr;
-    Token name;
+    Name name;
+    object::InlineCache cache;
+    Specialization specialization = Specialization::Uninitialized;
+    std::uint64_t shape = 0;  // Shape::id and field offset of the Field specialization
+    std::uint32_t offset = 0;
 };
 
-class Set : public ExprBase<Set> {
+class Set : public ExprBase<Set, Expr::Kind::Set> {
 public:
     Set(Expr *object, Token name, Expr *value);
 
     Expr *object = nullptr;
-    Token name;
+    Name name;
     Expr *value = nullptr;
+    object::InlineCache cache;
 };
 
-class Super : public ExprBase<Super> {
+class Super : public ExprBase<Super, Expr::Kind::Super> {
 public:
     Super(Token keyword, Token method);
 
-    Token keyword;
-    Token method;
+    Name keyword;
+    Name method;
+    Location location;
+    Location thisLocation;
 };
-class This : public ExprBase<This> {
+
+class This : public ExprBase<This, Expr::Kind::This> {
 public:
     explicit This(Token keyword);
-    Token keyword;
+    Name keyword;
+    Location location;
 };
 
 template <typename T>
@@ -178,13 +275,30 @@ public:
 
 class Stmt : public memory::Object {
 public:
+    // Which node the statement is, see Expr::Kind
+    enum class Kind : std::uint8_t { ExprStmt, If, FuncStmt, Print, Return, While, Block, Class, Var };
+
+    explicit Stmt(Kind kind)
+        : kind{kind}
+    {
+    }
+
     virtual std::string accept(IStmtVisitor<std::string> *visitor) = 0;
     virtual void accept(IStmtVisitor<void> *visitor) = 0;
+
+    const Kind kind;
+    // Whether executing the statement may run a call or return from one, see Expr::suspends
+    bool suspends = false;
 };
 
-template <typename T>
+template <typename T, Stmt::Kind K>
 class StmtBase : public Stmt {
 public:
+    StmtBase()
+        : Stmt{K}
+    {
+    }
+
     std::string accept(IStmtVisitor<std::string> *visitor) override
     {
         return visitor->visit(static_cast<T *>(this));
@@ -195,14 +309,14 @@ public:
     }
 };
 
-class ExprStmt : public StmtBase<ExprStmt> {
+class ExprStmt : public StmtBase<ExprStmt, Stmt::Kind::ExprStmt> {
 public:
     explicit ExprStmt(Expr *expr);
 
     Expr *expression = nullptr;
 };
 
-class If : public StmtBase<If> {
+class If : public StmtBase<If, Stmt::Kind::If> {
 public:
     If(Expr *condition, Stmt *thenBranch, Stmt *elseBranch);
 
@@ -211,30 +325,35 @@ public:
     Stmt *elseBranch = nullptr;
 };
 
-class FuncStmt : public StmtBase<FuncStmt> {
+class FuncStmt : public StmtBase<FuncStmt, Stmt::Kind::FuncStmt> {
 public:
     FuncStmt(Token name, std::vector<Token> params, std::vector<Stmt *> body);
 
-    Token name;
+    Name name;
     std::vector<Token> params;
     std::vector<Stmt *> body;
+
+    // Filled in by the Resolver
+    std::vector<Capture> captures;  // in upvalue order
+    std::vector<int> cellSlots;     // parameters and "this" that a closure captures
+    bool captured = false;          // whether a closure captures the function's own name
 };
 
-class Print : public StmtBase<Print> {
+class Print : public StmtBase<Print, Stmt::Kind::Print> {
 public:
     explicit Print(Expr *expr);
 
     Expr *expression = nullptr;
 };
 
-class Return : public StmtBase<Return> {
+class Return : public StmtBase<Return, Stmt::Kind::Return> {
 public:
     Return(Token keyword, Expr *value);
     Token keyword;
     Expr *value = nullptr;
 };
 
-class While : public StmtBase<While> {
+class While : public StmtBase<While, Stmt::Kind::While> {
 public:
     While(Expr *condition, Stmt *body);
 
@@ -242,28 +361,30 @@ public:
     Stmt *body = nullptr;
 };
 
-class Block : public StmtBase<Block> {
+class Block : public StmtBase<Block, Stmt::Kind::Block> {
 public:
     explicit Block(const std::vector<Stmt *> &statements);
 
     std::vector<Stmt *> statements;
 };
 
-class Class : public StmtBase<Class> {
+class Class : public StmtBase<Class, Stmt::Kind::Class> {
 public:
     Class(Token name, Variable *superclass, std::vector<FuncStmt *> methods);
 
-    Token name;
+    Name name;
     Variable *superclass = nullptr;
     std::vector<FuncStmt *> methods;
+    bool captured = false;  // set by the Resolver when a closure captures the class name
 };
 
-class Var : public StmtBase<Var> {
+class Var : public StmtBase<Var, Stmt::Kind::Var> {
 public:
     Var(Token name, Expr *initializer);
 
-    Token name;
+    Name name;
     Expr *initializer = nullptr;
+    bool captured = false;  // set by the Resolver when a closure captures the variable
 };
 
 }  // namespace draft
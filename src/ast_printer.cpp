@@ -25,17 +25,17 @@ std::string AstPrinter::visit(Literal *expr)
 
 std::string AstPrinter::visit(Logical *expr)
 {
-    return "Logic{" + expr->op.lexeme + ", " + expr->left->accept(this) + ", " + expr->right->accept(this) + "}";
+    return "Logic{" + std::string{expr->op.lexeme()} + ", " + expr->left->accept(this) + ", " + expr->right->accept(this) + "}";
 }
 
 std::string AstPrinter::visit(Unary *expr)
 {
-    return "UnOp{'" + expr->op.lexeme + "', " + expr->right->accept(this) + "}";
+    return "UnOp{'" + std::string{expr->op.lexeme()} + "', " + expr->right->accept(this) + "}";
 }
 
 std::string AstPrinter::visit(Binary *expr)
 {
-    return "BinOp{'" + expr->op.lexeme + "', " + expr->left->accept(this) + ", " + expr->right->accept(this) + "}";
+    return "BinOp{'" + std::string{expr->op.lexeme()} + "', " + expr->left->accept(this) + ", " + expr->right->accept(this) + "}";
 }
 
 std::string AstPrinter::visit(Call *expr)
@@ -54,32 +54,32 @@ std::string AstPrinter::visit(Grouping *expr)
 
 std::string AstPrinter::visit(Variable *expr)
 {
-    return "Var{" + expr->name.lexeme + "}";
+    return "Var{" + std::string{expr->name.lexeme()} + "}";
 }
 
 std::string AstPrinter::visit(Assign *expr)
 {
-    return "Assign{" + expr->name.lexeme + ", " + expr->value->accept(this) + "}";
+    return "Assign{" + std::string{expr->name.lexeme()} + ", " + expr->value->accept(this) + "}";
 }
 
 std::string AstPrinter::visit(Get *expr)
 {
-    return "Get{" + expr->name.lexeme + "}";
+    return "Get{" + std::string{expr->name.lexeme()} + "}";
 }
 
 std::string AstPrinter::visit(Set *expr)
 {
-    return "Set{" + expr->name.lexeme + "}";
+    return "Set{" + std::string{expr->name.lexeme()} + "}";
 }
 
 std::string AstPrinter::visit(Super *expr)
 {
-    return "Super{" + expr->keyword.lexeme + " " + expr->method.lexeme + "}";
+    return "Super{" + std::string{expr->keyword.lexeme()} + " " + std::string{expr->method.lexeme()} + "}";
 }
 
 std::string AstPrinter::visit(This *expr)
 {
-    return "This{" + expr->keyword.lexeme + "}";
+    return "This{" + std::string{expr->keyword.lexeme()} + "}";
 }
 
 std::string AstPrinter::visit(ExprStmt *stmt)
@@ -97,10 +97,10 @@ std::string AstPrinter::visit(If *stmt)
 
 std::string AstPrinter::visit(FuncStmt *stmt)
 {
-    std::string name = stmt->name.lexeme;
+    std::string name{stmt->name.lexeme()};
     std::string params;
     for (auto param : stmt->params) {
-        params.append(param.lexeme);
+        params.append(param.lexeme());
         params.append(", ");
     }
 
@@ -154,7 +154,7 @@ std::string AstPrinter::visit(Class *stmt)
 {
     std::string name;
     if (stmt) {
-        name = stmt->name.lexeme;
+        name = stmt->name.lexeme();
     }
     return "Class{" + name + "}";
 }
@@ -165,7 +165,7 @@ std::string AstPrinter::visit(Var *stmt)
     if (stmt->initializer) {
         initializer = stmt->initializer->accept(this);
     }
-    return "Var{" + stmt->name.lexeme + ", " + initializer + "}";
+    return "Var{" + std::string{stmt->name.lexeme()} + ", " + initializer + "}";
 }
 
 }  // namespace draft
@@ -4,12 +4,17 @@
 
 namespace draft {
 
+ClockFunction::ClockFunction()
+    : Callable{Kind::Native}
+{
+}
+
 std::size_t ClockFunction::arity()
 {
     return 0;
 }
 
-object::Object ClockFunction::call(Interpreter *, std::vector<object::Object>)
+object::Value ClockFunction::call(Interpreter *, object::Arguments)
 {
     namespace cr = std::chrono;
     auto now = cr::system_clock::now();
@@ -6,9 +6,11 @@ namespace draft {
 
 class ClockFunction : public object::Callable {
 public:
+    ClockFunction();
+
     std::size_t arity() override;
 
-    object::Object call(Interpreter *, std::vector<object::Object>) override;
+    object::Value call(Interpreter *, object::Arguments) override;
 };
 
 }  // namespace draft
@@ -0,0 +1,432 @@
+#include "chunk.h"
+
+#include <algorithm>
+
+#include "obj_closure.h"
+
+namespace draft {
+
+std::string opcode2str(OpCode op)
+{
+    switch (op) {
+#define OPCODE(name)   \
+    case OpCode::name: \
+        return #name;
+#include "opcode.def"
+    }
+    return "Unknown";
+}
+
+std::string registerOp2str(RegisterOp op)
+{
+    switch (op) {
+#define REGISTER_OP(name)  \
+    case RegisterOp::name: \
+        return #name;
+#include "register_op.def"
+    }
+    return "Unknown";
+}
+
+namespace {
+
+constexpr std::size_t registerOpCount()
+{
+    std::size_t count = 0;
+#define REGISTER_OP(name) ++count;
+#include "register_op.def"
+    return count;
+}
+
+static_assert(registerOpCount() <= 64, "register opcodes must fit into 6 bits");
+
+}  // namespace
+
+void Chunk::write(std::uint8_t byte, std::size_t line)
+{
+    if (lines.empty() or lines.back().line != line) {
+        lines.push_back(LineStart{code.size(), line});
+    }
+    code.push_back(byte);
+}
+
+void Chunk::write(OpCode op, std::size_t line)
+{
+    write(static_cast<std::uint8_t>(op), line);
+}
+
+void Chunk::write(Instruction instruction, std::size_t line)
+{
+    if (lines.empty() or lines.back().line != line) {
+        lines.push_back(LineStart{instructions.size(), line});
+    }
+    instructions.push_back(instruction);
+}
+
+void Chunk::writeShort(std::uint16_t value, std::size_t line)
+{
+    write(static_cast<std::uint8_t>(value >> 8), line);
+    write(static_cast<std::uint8_t>(value & 0xff), line);
+}
+
+void Chunk::patchShort(std::size_t offset, std::uint16_t value)
+{
+    code.at(offset) = static_cast<std::uint8_t>(value >> 8);
+    code.at(offset + 1) = static_cast<std::uint8_t>(value & 0xff);
+}
+
+std::size_t Chunk::addConstant(const object::Value &value)
+{
+    // Names are referenced over and over again, keep a single copy of each
+    if (value.isString()) {
+        auto it = std::find_if(constants.begin(), constants.end(),
+                               [&value](const object::Value &constant) { return constant.raw() == value.raw(); });
+        if (it != constants.end()) {
+            return std::distance(constants.begin(), it);
+        }
+    }
+    constants.push_back(value);
+    return constants.size() - 1;
+}
+
+std::size_t Chunk::addPrototype(object::PrototypePtr prototype)
+{
+    prototypes.push_back(prototype);
+    return prototypes.size() - 1;
+}
+
+std::size_t Chunk::addCache()
+{
+    caches.emplace_back();
+    return caches.size() - 1;
+}
+
+std::size_t Chunk::lineAt(std::size_t offset) const
+{
+    auto it = std::upper_bound(lines.begin(), lines.end(), offset,
+                               [](std::size_t value, const LineStart &start) { return value < start.offset; });
+    if (it == lines.begin()) {
+        return 0;
+    }
+    return std::prev(it)->line;
+}
+
+std::size_t Chunk::stackSize(std::size_t base) const
+{
+    auto readShort = [this](std::size_t at) { return static_cast<std::uint16_t>(code.at(at) << 8 | code.at(at + 1)); };
+
+    // Follows every path through the code. The compiler leaves the stack as deep wherever paths
+    // meet, so each instruction is only looked at once
+    std::vector<std::ptrdiff_t> depths(code.size(), -1);
+    std::vector<std::size_t> pending;
+    auto reach = [&depths, &pending](std::size_t offset, std::ptrdiff_t depth) {
+        // Code with compile errors may jump anywhere, it never runs
+        if (offset < depths.size() and depths[offset] == -1) {
+            depths[offset] = depth;
+            pending.push_back(offset);
+        }
+    };
+
+    std::ptrdiff_t most = static_cast<std::ptrdiff_t>(base);
+    if (!code.empty()) {
+        reach(0, most);
+    }
+    while (!pending.empty()) {
+        std::size_t offset = pending.back();
+        pending.pop_back();
+        std::ptrdiff_t depth = depths[offset];
+
+        std::size_t next = offset + 1;
+        std::ptrdiff_t effect = 0;
+        bool fallsThrough = true;
+        switch (static_cast<OpCode>(code.at(offset))) {
+        case OpCode::Constant:
+        case OpCode::GetGlobal:
+        case OpCode::Class:
+            effect = 1;
+            next += 2;
+            break;
+        case OpCode::Nil:
+        case OpCode::True:
+        case OpCode::False:
+            effect = 1;
+            break;
+        case OpCode::GetLocal:
+        case OpCode::GetUpvalue:
+            effect = 1;
+            next += 1;
+            break;
+        case OpCode::SetLocal:
+        case OpCode::SetUpvalue:
+            next += 1;
+            break;
+        case OpCode::SetGlobal:
+            next += 2;
+            break;
+        case OpCode::DefineGlobal:
+        case OpCode::GetSuper:
+        case OpCode::Method:
+            effect = -1;
+            next += 2;
+            break;
+        case OpCode::GetProperty:
+            next += 4;
+            break;
+        case OpCode::SetProperty:
+            effect = -1;
+            next += 4;
+            break;
+        case OpCode::Pop:
+        case OpCode::Equal:
+        case OpCode::NotEqual:
+        case OpCode::Greater:
+        case OpCode::GreaterEqual:
+        case OpCode::Less:
+        case OpCode::LessEqual:
+        case OpCode::Add:
+        case OpCode::Subtract:
+        case OpCode::Multiply:
+        case OpCode::Divide:
+        case OpCode::Print:
+        case OpCode::CloseUpvalue:
+        case OpCode::Inherit:
+            effect = -1;
+            break;
+        case OpCode::Not:
+        case OpCode::Negate:
+            break;
+        case OpCode::Jump:
+            next += 2;
+            reach(next + readShort(offset + 1), depth);
+            fallsThrough = false;
+            break;
+        case OpCode::JumpIfFalse:
+            next += 2;
+            reach(next + readShort(offset + 1), depth);
+            break;
+        case OpCode::Loop:
+            next += 2;
+            reach(next - readShort(offset + 1), depth);
+            fallsThrough = false;
+            break;
+        // The callee and arguments make way for the result
+        case OpCode::Call:
+        case OpCode::TailCall:
+            effect = -static_cast<std::ptrdiff_t>(code.at(offset + 1));
+            next += 3;
+            break;
+        case OpCode::Invoke:
+        case OpCode::TailInvoke:
+            effect = -static_cast<std::ptrdiff_t>(code.at(offset + 3));
+            next += 7;
+            break;
+        case OpCode::Closure:
+            effect = 1;
+            next += 2 + 2 * prototypes.at(readShort(offset + 1))->upvalueCount;
+            break;
+        case OpCode::Return:
+            fallsThrough = false;
+            break;
+        }
+        most = std::max(most, depth + effect);
+        if (fallsThrough and next < code.size()) {
+            reach(next, depth + effect);
+        }
+    }
+    return static_cast<std::size_t>(most);
+}
+
+std::string Chunk::disassemble(const std::string &name) const
+{
+    std::string out = "== " + name + " ==\n";
+    for (std::size_t offset = 0; offset < code.size();) {
+        offset = disassembleInstruction(offset, out);
+    }
+    return out;
+}
+
+std::size_t Chunk::disassembleInstruction(std::size_t offset, std::string &out) const
+{
+    auto readShort = [this](std::size_t at) { return static_cast<std::uint16_t>(code.at(at) << 8 | code.at(at + 1)); };
+
+    auto op = static_cast<OpCode>(code.at(offset));
+    out += std::to_string(offset) + " [line " + std::to_string(lineAt(offset)) + "] " + opcode2str(op);
+
+    std::size_t next = offset + 1;
+    switch (op) {
+    case OpCode::Constant:
+    case OpCode::GetGlobal:
+    case OpCode::DefineGlobal:
+    case OpCode::SetGlobal:
+    case OpCode::GetSuper:
+    case OpCode::Class:
+    case OpCode::Method: {
+        std::uint16_t constant = readShort(next);
+        out += " " + std::to_string(constant) + " '" + object::obj2str(constants.at(constant)) + "'";
+        next += 2;
+        break;
+    }
+    case OpCode::GetProperty:
+    case OpCode::SetProperty: {
+        std::uint16_t constant = readShort(next);
+        out += " " + std::to_string(constant) + " '" + object::obj2str(constants.at(constant)) + "'";
+        out += " cache " + std::to_string(readShort(next + 2));
+        next += 4;
+        break;
+    }
+    case OpCode::GetLocal:
+    case OpCode::SetLocal:
+    case OpCode::GetUpvalue:
+    case OpCode::SetUpvalue:
+        out += " " + std::to_string(code.at(next));
+        next += 1;
+        break;
+    case OpCode::Call:
+    case OpCode::TailCall:
+        out += " " + std::to_string(code.at(next)) + " cache " + std::to_string(readShort(next + 1));
+        next += 3;
+        break;
+    case OpCode::Invoke:
+    case OpCode::TailInvoke: {
+        std::uint16_t constant = readShort(next);
+        out += " " + std::to_string(constant) + " '" + object::obj2str(constants.at(constant)) + "'";
+        out += " " + std::to_string(code.at(next + 2)) + " cache " + std::to_string(readShort(next + 3));
+        out += " cache " + std::to_string(readShort(next + 5));
+        next += 7;
+        break;
+    }
+    case OpCode::Jump:
+    case OpCode::JumpIfFalse:
+        out += " -> " + std::to_string(next + 2 + readShort(next));
+        next += 2;
+        break;
+    case OpCode::Loop:
+        out += " -> " + std::to_string(next + 2 - readShort(next));
+        next += 2;
+        break;
+    case OpCode::Closure: {
+        std::uint16_t index = readShort(next);
+        next += 2;
+        const auto &prototype = prototypes.at(index);
+        out += " <fn " + prototype->name + ">";
+        for (std::size_t i = 0; i < prototype->upvalueCount; ++i) {
+            out += code.at(next) ? " local " : " upvalue ";
+            out += std::to_string(code.at(next + 1));
+            next += 2;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    out += "\n";
+    return next;
+}
+
+std::string Chunk::disassembleRegisters(const std::string &name) const
+{
+    std::string out = "== " + name + " ==\n";
+    for (std::size_t offset = 0; offset < instructions.size();) {
+        offset = disassembleRegisterInstruction(offset, out);
+    }
+    return out;
+}
+
+std::size_t Chunk::disassembleRegisterInstruction(std::size_t offset, std::string &out) const
+{
+    auto reg = [](std::uint32_t operand) { return "r" + std::to_string(operand); };
+    auto rk = [this, &reg](std::uint32_t operand) {
+        if (operand < Instruction::ConstantBit) {
+            return reg(operand);
+        }
+        return "'" + object::obj2str(constants.at(operand - Instruction::ConstantBit)) + "'";
+    };
+    auto constant = [this](std::size_t index) { return " '" + object::obj2str(constants.at(index)) + "'"; };
+
+    Instruction instruction = instructions.at(offset);
+    out += std::to_string(offset) + " [line " + std::to_string(lineAt(offset)) + "] " +
+           registerOp2str(instruction.op());
+
+    std::size_t next = offset + 1;
+    std::uint32_t a = instruction.a();
+    switch (instruction.op()) {
+    case RegisterOp::Move:
+    case RegisterOp::Not:
+    case RegisterOp::Negate:
+    case RegisterOp::Inherit:
+        out += " " + reg(a) + " " + reg(instruction.b());
+        break;
+    case RegisterOp::Constant:
+    case RegisterOp::GetGlobal:
+    case RegisterOp::DefineGlobal:
+    case RegisterOp::SetGlobal:
+    case RegisterOp::Class:
+        out += " " + reg(a) + constant(instruction.bx());
+        break;
+    case RegisterOp::Nil:
+    case RegisterOp::Print:
+    case RegisterOp::Close:
+    case RegisterOp::Return:
+        out += " " + reg(a);
+        break;
+    case RegisterOp::Boolean:
+        out += " " + reg(a) + (instruction.b() ? " true" : " false");
+        break;
+    case RegisterOp::GetUpvalue:
+    case RegisterOp::SetUpvalue:
+        out += " " + reg(a) + " " + std::to_string(instruction.b());
+        break;
+    case RegisterOp::GetProperty:
+    case RegisterOp::SetProperty:
+    case RegisterOp::GetSuper:
+    case RegisterOp::Method: {
+        Instruction extra = instructions.at(next++);
+        out += " " + reg(a) + " " + reg(instruction.b());
+        if (instruction.op() == RegisterOp::GetSuper) {
+            out += " " + reg(instruction.c());
+        }
+        out += constant(extra.name());
+        if (instruction.op() != RegisterOp::Method) {
+            out += " cache " + std::to_string(extra.cache());
+        }
+        break;
+    }
+    case RegisterOp::Jump:
+        out += " -> " + std::to_string(next + instruction.sbx());
+        break;
+    case RegisterOp::JumpIfFalse:
+    case RegisterOp::JumpIfTrue:
+        out += " " + reg(a) + " -> " + std::to_string(next + instruction.sbx());
+        break;
+    case RegisterOp::Call:
+    case RegisterOp::TailCall:
+        out += " " + reg(a) + " " + std::to_string(instruction.b()) + " cache " +
+               std::to_string(instructions.at(next++).cache());
+        break;
+    case RegisterOp::Invoke:
+    case RegisterOp::TailInvoke: {
+        Instruction extra = instructions.at(next++);
+        out += " " + reg(a) + " " + std::to_string(instruction.b()) + constant(extra.name());
+        out += " cache " + std::to_string(extra.cache());
+        out += " cache " + std::to_string(instructions.at(next++).cache());
+        break;
+    }
+    case RegisterOp::Closure: {
+        const auto &prototype = prototypes.at(instruction.bx());
+        out += " " + reg(a) + " <fn " + prototype->name + ">";
+        for (std::size_t i = 0; i < prototype->upvalueCount; ++i) {
+            Instruction upvalue = instructions.at(next++);
+            out += upvalue.a() ? " local " : " upvalue ";
+            out += std::to_string(upvalue.b());
+        }
+        break;
+    }
+    default:
+        out += " " + reg(a) + " " + rk(instruction.b()) + " " + rk(instruction.c());
+        break;
+    }
+    out += "\n";
+    return next;
+}
+
+}  // namespace draft
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "inline_cache.h"
+#include "object.h"
+
+namespace draft {
+namespace object {
+class Prototype;
+using PrototypePtr = Prototype *;
+}  // namespace object
+
+enum class OpCode : std::uint8_t {
+#define OPCODE(name) name,
+#include "opcode.def"
+};
+
+std::string opcode2str(OpCode op);
+
+enum class RegisterOp : std::uint8_t {
+#define REGISTER_OP(name) name,
+#include "register_op.def"
+};
+
+std::string registerOp2str(RegisterOp op);
+
+// One word of register machine code, from the low bits: a 6-bit opcode, an 8-bit operand A, then
+// either 9-bit operands B and C or an 18-bit Bx, which also serves as the signed offset sBx
+class Instruction {
+public:
+    static constexpr std::uint32_t MaxA = 0xff;
+    static constexpr std::uint32_t MaxB = 0x1ff;
+    static constexpr std::uint32_t MaxBx = 0x3ffff;
+    static constexpr std::int32_t MaxSBx = MaxBx >> 1;
+    // B and C at or above this refer to constant (operand - ConstantBit), see register_op.def
+    static constexpr std::uint32_t ConstantBit = 0x100;
+
+    static Instruction abc(RegisterOp op, std::uint32_t a, std::uint32_t b = 0, std::uint32_t c = 0)
+    {
+        return Instruction{static_cast<std::uint32_t>(op) | a << 6 | b << 14 | c << 23};
+    }
+    static Instruction abx(RegisterOp op, std::uint32_t a, std::uint32_t bx)
+    {
+        return Instruction{static_cast<std::uint32_t>(op) | a << 6 | bx << 14};
+    }
+    static Instruction asbx(RegisterOp op, std::uint32_t a, std::int32_t sbx)
+    {
+        return abx(op, a, static_cast<std::uint32_t>(sbx + MaxSBx));
+    }
+    // The word following GetProperty, SetProperty, GetSuper, Method and the calls
+    static Instruction extra(std::uint16_t name, std::uint16_t cache)
+    {
+        return Instruction{static_cast<std::uint32_t>(name) << 16 | cache};
+    }
+
+    RegisterOp op() const
+    {
+        return static_cast<RegisterOp>(bits & 0x3f);
+    }
+    std::uint32_t a() const
+    {
+        return bits >> 6 & MaxA;
+    }
+    std::uint32_t b() const
+    {
+        return bits >> 14 & MaxB;
+    }
+    std::uint32_t c() const
+    {
+        return bits >> 23;
+    }
+    std::uint32_t bx() const
+    {
+        return bits >> 14;
+    }
+    std::int32_t sbx() const
+    {
+        return static_cast<std::int32_t>(bx()) - MaxSBx;
+    }
+    std::uint16_t name() const
+    {
+        return static_cast<std::uint16_t>(bits >> 16);
+    }
+    std::uint16_t cache() const
+    {
+        return static_cast<std::uint16_t>(bits);
+    }
+
+private:
+    explicit Instruction(std::uint32_t bits)
+        : bits{bits}
+    {
+    }
+
+    std::uint32_t bits;
+};
+
+// A sequence of bytecode together with the data it refers to. The stack machine's code is a byte
+// stream, the register machine's a sequence of instructions; a chunk holds only one of them
+class Chunk {
+public:
+    void write(std::uint8_t byte, std::size_t line);
+    void write(OpCode op, std::size_t line);
+    void write(Instruction instruction, std::size_t line);
+    void writeShort(std::uint16_t value, std::size_t line);
+    void patchShort(std::size_t offset, std::uint16_t value);
+
+    std::size_t addConstant(const object::Value &value);
+    std::size_t addPrototype(object::PrototypePtr prototype);
+    std::size_t addCache();
+
+    std::size_t lineAt(std::size_t offset) const;
+    // Most values the stack machine code keeps on the stack at once, counting from the first slot
+    // of its frame, which starts out holding base values: the callee and its arguments
+    std::size_t stackSize(std::size_t base) const;
+
+    std::string disassemble(const std::string &name) const;
+    std::size_t disassembleInstruction(std::size_t offset, std::string &out) const;
+    std::string disassembleRegisters(const std::string &name) const;
+    std::size_t disassembleRegisterInstruction(std::size_t offset, std::string &out) const;
+
+    std::vector<std::uint8_t> code;
+    std::vector<Instruction> instructions;
+    std::vector<object::Value> constants;
+    std::vector<object::PrototypePtr> prototypes;
+    // One per property access and call instruction
+    std::vector<object::InlineCache> caches;
+
+private:
+    // Run-length encoded line table, one entry per run of bytes emitted for the same line
+    struct LineStart {
+        std::size_t offset = 0;
+        std::size_t line = 0;
+    };
+    std::vector<LineStart> lines;
+};
+
+}  // namespace draft
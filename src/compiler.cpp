@@ -0,0 +1,616 @@
+#include "compiler.h"
+
+#include <limits>
+
+#include "driver.h"
+
+namespace draft {
+
+constexpr std::size_t MaxLocals = std::numeric_limits<std::uint8_t>::max() + 1;
+constexpr std::size_t MaxUpvalues = std::numeric_limits<std::uint8_t>::max() + 1;
+constexpr std::size_t MaxConstants = std::numeric_limits<std::uint16_t>::max() + 1;
+constexpr std::size_t MaxCaches = std::numeric_limits<std::uint16_t>::max() + 1;
+constexpr std::size_t MaxJump = std::numeric_limits<std::uint16_t>::max();
+
+Compiler::Compiler()
+{
+    object::heap().addRoots(this);
+}
+
+Compiler::~Compiler()
+{
+    object::heap().removeRoots(this);
+}
+
+void Compiler::markRoots(object::Heap &heap)
+{
+    for (FunctionState *state = current; state; state = state->enclosing) {
+        heap.mark(state->prototype);
+    }
+}
+
+object::PrototypePtr Compiler::compile(const std::vector<Stmt *> &statements)
+{
+    FunctionState script;
+    script.prototype = object::make<object::Prototype>("script");
+    // Slot zero of every frame belongs to the function being called
+    script.locals.push_back(Local{"", 0});
+    current = &script;
+
+    for (Stmt *stmt : statements) {
+        compile(stmt);
+    }
+    emitReturn();
+    script.prototype->stackSize = chunk().stackSize(1);
+
+    current = nullptr;
+    return script.prototype;
+}
+
+object::Value Compiler::visit(Literal *expr)
+{
+    if (expr->value.isNil()) {
+        emit(OpCode::Nil);
+    } else if (expr->value.isBool()) {
+        emit(expr->value.asBool() ? OpCode::True : OpCode::False);
+    } else {
+        emit(OpCode::Constant, makeConstant(expr->value));
+    }
+    return object::Null{};
+}
+
+object::Value Compiler::visit(Logical *expr)
+{
+    compile(expr->left);
+    line = expr->op.line;
+
+    if (expr->op.kind == Token::Kind::Or) {
+        std::size_t elseJump = emitJump(OpCode::JumpIfFalse);
+        std::size_t endJump = emitJump(OpCode::Jump);
+        patchJump(elseJump);
+        emit(OpCode::Pop);
+        compile(expr->right);
+        patchJump(endJump);
+    } else {
+        std::size_t endJump = emitJump(OpCode::JumpIfFalse);
+        emit(OpCode::Pop);
+        compile(expr->right);
+        patchJump(endJump);
+    }
+    return object::Null{};
+}
+
+object::Value Compiler::visit(Unary *expr)
+{
+    compile(expr->right);
+    line = expr->op.line;
+
+    switch (expr->op.kind) {
+    case Token::Kind::HyphenMinus:
+        emit(OpCode::Negate);
+        break;
+    case Token::Kind::ExclamationMark:
+        emit(OpCode::Not);
+        break;
+    default:
+        break;
+    }
+    return object::Null{};
+}
+
+object::Value Compiler::visit(Binary *expr)
+{
+    compile(expr->left);
+    compile(expr->right);
+    line = expr->op.line;
+
+    switch (expr->op.kind) {
+    case Token::Kind::GreaterThanSign:
+        emit(OpCode::Greater);
+        break;
+    case Token::Kind::GreaterEqual:
+        emit(OpCode::GreaterEqual);
+        break;
+    case Token::Kind::LessThanSign:
+        emit(OpCode::Less);
+        break;
+    case Token::Kind::LessEqual:
+        emit(OpCode::LessEqual);
+        break;
+    case Token::Kind::ExclaimEqual:
+        emit(OpCode::NotEqual);
+        break;
+    case Token::Kind::EqualEqual:
+        emit(OpCode::Equal);
+        break;
+    case Token::Kind::HyphenMinus:
+        emit(OpCode::Subtract);
+        break;
+    case Token::Kind::PlusSign:
+        emit(OpCode::Add);
+        break;
+    case Token::Kind::Solidus:
+        emit(OpCode::Divide);
+        break;
+    case Token::Kind::Asterisk:
+        emit(OpCode::Multiply);
+        break;
+    default:
+        break;
+    }
+    return object::Null{};
+}
+
+object::Value Compiler::visit(Call *expr)
+{
+    if (expr->callee->kind == Expr::Kind::Get) {
+        // A method is called on the receiver in place of the callee, without binding it
+        auto *get = static_cast<Get *>(expr->callee);
+        compile(get->object);
+        for (Expr *argument : expr->arguments) {
+            compile(argument);
+        }
+        line = expr->paren.line;
+        emit(expr->tail ? OpCode::TailInvoke : OpCode::Invoke, identifierConstant(get->name.lexeme()));
+        emitByte(static_cast<std::uint8_t>(expr->arguments.size()));
+        emitCache();
+        emitCache();
+        return object::Null{};
+    }
+
+    compile(expr->callee);
+    for (Expr *argument : expr->arguments) {
+        compile(argument);
+    }
+    line = expr->paren.line;
+    // The Return that follows a tail call only runs if the callee could not take over the frame
+    emit(expr->tail ? OpCode::TailCall : OpCode::Call);
+    emitByte(static_cast<std::uint8_t>(expr->arguments.size()));
+    emitCache();
+    return object::Null{};
+}
+
+object::Value Compiler::visit(Grouping *expr)
+{
+    compile(expr->expression);
+    return object::Null{};
+}
+
+object::Value Compiler::visit(Variable *expr)
+{
+    line = expr->name.line;
+    namedVariable(expr->name.lexeme(), false);
+    return object::Null{};
+}
+
+object::Value Compiler::visit(Assign *expr)
+{
+    compile(expr->value);
+    line = expr->name.line;
+    namedVariable(expr->name.lexeme(), true);
+    return object::Null{};
+}
+
+object::Value Compiler::visit(Get *expr)
+{
+    compile(expr->object);
+    line = expr->name.line;
+    emit(OpCode::GetProperty, identifierConstant(expr->name.lexeme()));
+    emitCache();
+    return object::Null{};
+}
+
+object::Value Compiler::visit(Set *expr)
+{
+    compile(expr->object);
+    compile(expr->value);
+    line = expr->name.line;
+    emit(OpCode::SetProperty, identifierConstant(expr->name.lexeme()));
+    emitCache();
+    return object::Null{};
+}
+
+object::Value Compiler::visit(Super *expr)
+{
+    line = expr->keyword.line;
+    namedVariable("this", false);
+    namedVariable("super", false);
+    emit(OpCode::GetSuper, identifierConstant(expr->method.lexeme()));
+    return object::Null{};
+}
+
+object::Value Compiler::visit(This *expr)
+{
+    line = expr->keyword.line;
+    namedVariable("this", false);
+    return object::Null{};
+}
+
+void Compiler::visit(ExprStmt *stmt)
+{
+    compile(stmt->expression);
+    emit(OpCode::Pop);
+}
+
+void Compiler::visit(If *stmt)
+{
+    compile(stmt->condition);
+
+    std::size_t thenJump = emitJump(OpCode::JumpIfFalse);
+    emit(OpCode::Pop);
+    compile(stmt->thenBranch);
+    std::size_t elseJump = emitJump(OpCode::Jump);
+
+    patchJump(thenJump);
+    emit(OpCode::Pop);
+    if (stmt->elseBranch) {
+        compile(stmt->elseBranch);
+    }
+    patchJump(elseJump);
+}
+
+void Compiler::visit(FuncStmt *stmt)
+{
+    line = stmt->name.line;
+    std::uint16_t global = 0;
+    if (current->scopeDepth > 0) {
+        declareVariable(stmt->name.lexeme());
+        // A local function can refer to itself before its body is compiled
+        markInitialized();
+    } else {
+        global = identifierConstant(stmt->name.lexeme());
+    }
+    function(stmt, FunctionType::Function);
+    defineVariable(global);
+}
+
+void Compiler::visit(Print *stmt)
+{
+    compile(stmt->expression);
+    emit(OpCode::Print);
+}
+
+void Compiler::visit(Return *stmt)
+{
+    line = stmt->keyword.line;
+    if (!stmt->value) {
+        emitReturn();
+        return;
+    }
+    compile(stmt->value);
+    emit(OpCode::Return);
+}
+
+void Compiler::visit(While *stmt)
+{
+    std::size_t loopStart = chunk().code.size();
+    compile(stmt->condition);
+
+    std::size_t exitJump = emitJump(OpCode::JumpIfFalse);
+    emit(OpCode::Pop);
+    compile(stmt->body);
+    emitLoop(loopStart);
+
+    patchJump(exitJump);
+    emit(OpCode::Pop);
+}
+
+void Compiler::visit(Block *stmt)
+{
+    beginScope();
+    for (Stmt *s : stmt->statements) {
+        compile(s);
+    }
+    endScope();
+}
+
+void Compiler::visit(Class *stmt)
+{
+    line = stmt->name.line;
+    std::string_view className = stmt->name.lexeme();
+    std::uint16_t nameConstant = identifierConstant(className);
+    if (current->scopeDepth > 0) {
+        declareVariable(className);
+    }
+
+    emit(OpCode::Class, nameConstant);
+    defineVariable(nameConstant);
+
+    ClassState classState;
+    classState.enclosing = currentClass;
+    currentClass = &classState;
+
+    if (stmt->superclass) {
+        visit(stmt->superclass);
+
+        // Methods capture the superclass through a local named "super"
+        beginScope();
+        addLocal("super");
+        markInitialized();
+
+        namedVariable(className, false);
+        emit(OpCode::Inherit);
+        classState.hasSuperclass = true;
+    }
+
+    namedVariable(className, false);
+    for (FuncStmt *method : stmt->methods) {
+        line = method->name.line;
+        std::uint16_t methodName = identifierConstant(method->name.lexeme());
+        FunctionType type = method->name.lexeme() == "init" ? FunctionType::Initializer : FunctionType::Method;
+        function(method, type);
+        emit(OpCode::Method, methodName);
+    }
+    emit(OpCode::Pop);
+
+    if (classState.hasSuperclass) {
+        endScope();
+    }
+    currentClass = currentClass->enclosing;
+}
+
+void Compiler::visit(Var *stmt)
+{
+    line = stmt->name.line;
+    std::uint16_t global = 0;
+    if (current->scopeDepth > 0) {
+        declareVariable(stmt->name.lexeme());
+    } else {
+        global = identifierConstant(stmt->name.lexeme());
+    }
+
+    if (stmt->initializer) {
+        compile(stmt->initializer);
+    } else {
+        emit(OpCode::Nil);
+    }
+    defineVariable(global);
+}
+
+void Compiler::compile(Stmt *stmt)
+{
+    if (stmt) {
+        stmt->accept(this);
+    }
+}
+
+void Compiler::compile(Expr *expr)
+{
+    if (expr) {
+        expr->accept(this);
+    } else {
+        emit(OpCode::Nil);
+    }
+}
+
+void Compiler::function(FuncStmt *stmt, FunctionType type)
+{
+    FunctionState state;
+    state.enclosing = current;
+    state.type = type;
+    state.prototype = object::make<object::Prototype>(std::string{stmt->name.lexeme()});
+    state.prototype->arity = stmt->params.size();
+    // Methods receive the instance in slot zero
+    state.locals.push_back(Local{type == FunctionType::Function ? "" : "this", 0});
+    current = &state;
+
+    beginScope();
+    for (const Token &param : stmt->params) {
+        line = param.line;
+        declareVariable(param.lexeme());
+        markInitialized();
+    }
+    for (Stmt *s : stmt->body) {
+        compile(s);
+    }
+    emitReturn();
+    state.prototype->stackSize = chunk().stackSize(stmt->params.size() + 1);
+
+    current = state.enclosing;
+
+    state.prototype->upvalueCount = state.upvalues.size();
+    std::size_t index = chunk().addPrototype(state.prototype);
+    if (index >= MaxConstants) {
+        error("Too many functions in one chunk");
+    }
+    emit(OpCode::Closure, static_cast<std::uint16_t>(index));
+    for (const Upvalue &upvalue : state.upvalues) {
+        emitByte(upvalue.isLocal ? 1 : 0);
+        emitByte(upvalue.index);
+    }
+}
+
+Chunk &Compiler::chunk()
+{
+    return current->prototype->chunk;
+}
+
+void Compiler::emit(OpCode op)
+{
+    chunk().write(op, line);
+}
+
+void Compiler::emit(OpCode op, std::uint16_t operand)
+{
+    chunk().write(op, line);
+    chunk().writeShort(operand, line);
+}
+
+void Compiler::emitByte(std::uint8_t byte)
+{
+    chunk().write(byte, line);
+}
+
+void Compiler::emitCache()
+{
+    std::size_t cache = chunk().addCache();
+    if (cache >= MaxCaches) {
+        error("Too many property accesses and calls in one chunk");
+        return;
+    }
+    chunk().writeShort(static_cast<std::uint16_t>(cache), line);
+}
+
+std::size_t Compiler::emitJump(OpCode op)
+{
+    emit(op, 0xffff);
+    return chunk().code.size() - 2;
+}
+
+void Compiler::patchJump(std::size_t offset)
+{
+    // -2 to adjust for the bytecode for the jump offset itself
+    std::size_t jump = chunk().code.size() - offset - 2;
+    if (jump > MaxJump) {
+        error("Too much code to jump over");
+    }
+    chunk().patchShort(offset, static_cast<std::uint16_t>(jump));
+}
+
+void Compiler::emitLoop(std::size_t loopStart)
+{
+    // +3 to also jump over the Loop instruction and its operand
+    std::size_t offset = chunk().code.size() - loopStart + 3;
+    if (offset > MaxJump) {
+        error("Loop body too large");
+    }
+    emit(OpCode::Loop, static_cast<std::uint16_t>(offset));
+}
+
+void Compiler::emitReturn()
+{
+    if (current->type == FunctionType::Initializer) {
+        emit(OpCode::GetLocal);
+        emitByte(0);
+    } else {
+        emit(OpCode::Nil);
+    }
+    emit(OpCode::Return);
+}
+
+std::uint16_t Compiler::makeConstant(const object::Value &value)
+{
+    std::size_t constant = chunk().addConstant(value);
+    if (constant >= MaxConstants) {
+        error("Too many constants in one chunk");
+        return 0;
+    }
+    return static_cast<std::uint16_t>(constant);
+}
+
+std::uint16_t Compiler::identifierConstant(std::string_view name)
+{
+    return makeConstant(object::intern(name));
+}
+
+void Compiler::beginScope()
+{
+    current->scopeDepth++;
+}
+
+void Compiler::endScope()
+{
+    current->scopeDepth--;
+
+    auto &locals = current->locals;
+    while (!locals.empty() and locals.back().depth > current->scopeDepth) {
+        emit(locals.back().isCaptured ? OpCode::CloseUpvalue : OpCode::Pop);
+        locals.pop_back();
+    }
+}
+
+void Compiler::addLocal(std::string_view name)
+{
+    if (current->locals.size() >= MaxLocals) {
+        error("Too many local variables in function");
+        return;
+    }
+    current->locals.push_back(Local{name, -1});
+}
+
+void Compiler::declareVariable(std::string_view name)
+{
+    // The resolver has already rejected redeclarations in the same scope
+    addLocal(name);
+}
+
+void Compiler::markInitialized()
+{
+    if (current->scopeDepth == 0) {
+        return;
+    }
+    current->locals.back().depth = current->scopeDepth;
+}
+
+void Compiler::defineVariable(std::uint16_t global)
+{
+    if (current->scopeDepth > 0) {
+        markInitialized();
+        return;
+    }
+    emit(OpCode::DefineGlobal, global);
+}
+
+void Compiler::namedVariable(std::string_view name, bool assign)
+{
+    if (int slot = resolveLocal(current, name); slot != -1) {
+        emit(assign ? OpCode::SetLocal : OpCode::GetLocal);
+        emitByte(static_cast<std::uint8_t>(slot));
+    } else if (int index = resolveUpvalue(current, name); index != -1) {
+        emit(assign ? OpCode::SetUpvalue : OpCode::GetUpvalue);
+        emitByte(static_cast<std::uint8_t>(index));
+    } else {
+        emit(assign ? OpCode::SetGlobal : OpCode::GetGlobal, identifierConstant(name));
+    }
+}
+
+int Compiler::resolveLocal(FunctionState *state, std::string_view name)
+{
+    for (int i = state->locals.size() - 1; i >= 0; i--) {
+        if (state->locals.at(i).name == name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int Compiler::resolveUpvalue(FunctionState *state, std::string_view name)
+{
+    if (!state->enclosing) {
+        return -1;
+    }
+
+    if (int local = resolveLocal(state->enclosing, name); local != -1) {
+        state->enclosing->locals.at(local).isCaptured = true;
+        return addUpvalue(state, static_cast<std::uint8_t>(local), true);
+    }
+
+    if (int upvalue = resolveUpvalue(state->enclosing, name); upvalue != -1) {
+        return addUpvalue(state, static_cast<std::uint8_t>(upvalue), false);
+    }
+    return -1;
+}
+
+int Compiler::addUpvalue(FunctionState *state, std::uint8_t index, bool isLocal)
+{
+    auto &upvalues = state->upvalues;
+    for (std::size_t i = 0; i < upvalues.size(); ++i) {
+        if (upvalues.at(i).index == index and upvalues.at(i).isLocal == isLocal) {
+            return i;
+        }
+    }
+
+    if (upvalues.size() >= MaxUpvalues) {
+        error("Too many closure variables in function");
+        return 0;
+    }
+    upvalues.push_back(Upvalue{index, isLocal});
+    return upvalues.size() - 1;
+}
+
+void Compiler::error(const std::string &message)
+{
+    Driver::error(line, message);
+}
+
+}  // namespace draft
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ast.h"
+#include "chunk.h"
+#include "heap.h"
+#include "obj_closure.h"
+
+namespace draft {
+
+// Turns a resolved syntax tree into bytecode for the VM. Every function declaration becomes a
+// prototype with its own chunk; the top-level statements are compiled into an implicit script
+// function
+class Compiler : public IExprVisitor<object::Value>, IStmtVisitor<void>, object::RootSet {
+public:
+    Compiler();
+    ~Compiler() override;
+
+    object::PrototypePtr compile(const std::vector<Stmt *> &statements);
+
+    // The prototypes being compiled are not reachable from anywhere else yet
+    void markRoots(object::Heap &heap) override;
+
+private:
+    enum class FunctionType { Script, Function, Initializer, Method };
+
+    struct Local {
+        std::string_view name;
+        int depth = -1;  // -1 until the variable is initialized
+        bool isCaptured = false;
+    };
+
+    struct Upvalue {
+        std::uint8_t index = 0;
+        bool isLocal = false;
+    };
+
+    // Compilation state of a single function, chained to the function it is nested in
+    struct FunctionState {
+        FunctionState *enclosing = nullptr;
+        object::PrototypePtr prototype = nullptr;
+        FunctionType type = FunctionType::Script;
+        std::vector<Local> locals;
+        std::vector<Upvalue> upvalues;
+        int scopeDepth = 0;
+    };
+
+    struct ClassState {
+        ClassState *enclosing = nullptr;
+        bool hasSuperclass = false;
+    };
+
+    object::Value visit(Literal *expr) override;
+    object::Value visit(Logical *expr) override;
+    object::Value visit(Unary *expr) override;
+    object::Value visit(Binary *expr) override;
+    object::Value visit(Call *expr) override;
+    object::Value visit(Grouping *expr) override;
+    object::Value visit(Variable *expr) override;
+    object::Value visit(Assign *expr) override;
+    object::Value visit(Get *expr) override;
+    object::Value visit(Set *expr) override;
+    object::Value visit(Super *expr) override;
+    object::Value visit(This *expr) override;
+
+    void visit(ExprStmt *stmt) override;
+    void visit(If *stmt) override;
+    void visit(FuncStmt *stmt) override;
+    void visit(Print *stmt) override;
+    void visit(Return *stmt) override;
+    void visit(While *stmt) override;
+    void visit(Block *stmt) override;
+    void visit(Class *stmt) override;
+    void visit(Var *stmt) override;
+
+    void compile(Stmt *stmt);
+    void compile(Expr *expr);
+    void function(FuncStmt *stmt, FunctionType type);
+
+    Chunk &chunk();
+    void emit(OpCode op);
+    void emit(OpCode op, std::uint16_t operand);
+    void emitByte(std::uint8_t byte);
+    // Gives the instruction just emitted an inline cache of its own
+    void emitCache();
+    std::size_t emitJump(OpCode op);
+    void patchJump(std::size_t offset);
+    void emitLoop(std::size_t loopStart);
+    void emitReturn();
+    std::uint16_t makeConstant(const object::Value &value);
+    std::uint16_t identifierConstant(std::string_view name);
+
+    void beginScope();
+    void endScope();
+    void addLocal(std::string_view name);
+    void declareVariable(std::string_view name);
+    void markInitialized();
+    void defineVariable(std::uint16_t global);
+    void namedVariable(std::string_view name, bool assign);
+    int resolveLocal(FunctionState *state, std::string_view name);
+    int resolveUpvalue(FunctionState *state, std::string_view name);
+    int addUpvalue(FunctionState *state, std::uint8_t index, bool isLocal);
+
+    void error(const std::string &message);
+
+    FunctionState *current = nullptr;
+    ClassState *currentClass = nullptr;
+    std::size_t line = 1;  // line of the most recent token seen, literals carry none
+};
+
+}  // namespace draft
@@ -1,14 +1,18 @@
 #include "driver.h"
 
-#include <fstream>
-
 #include "ast.h"
 #include "ast_printer.h"
+#include "compiler.h"
+#include "heap.h"
 #include "lexer.h"
 #include "parser.h"
+#include "register_compiler.h"
+#include "register_vm.h"
 #include "resolver.h"
+#include "scan.h"
 #include "source_manager.h"
 #include "token.h"
+#include "vm.h"
 
 namespace draft {
 namespace io {
@@ -46,10 +50,23 @@ void writeColoredLine(const std::string &line)
 }  // namespace io
 
 bool Driver::hadError = false;
+bool Driver::hadRuntimeError = false;
+Driver::Engine Driver::engine = Driver::Engine::Stack;
+bool Driver::heapStats = false;
+bool Driver::cacheStats = false;
+bool Driver::dispatchStats = false;
+std::size_t Driver::dispatched = 0;
+bool Driver::scanStats = false;
+Driver::Scanned Driver::scanned;
+std::vector<std::unique_ptr<memory::Arena>> Driver::syntaxTrees;
+std::size_t Driver::maxDepth = Interpreter::DefaultMaxDepth;
 
 int Driver::usage()
 {
-    io::writeLine("Usage: draft [filename]", std::cerr);
+    io::writeLine("Usage: draft [--engine=stack|register|tree] [--gc-growth=factor] [--gc-stress] [--gc-stats] [--cache-stats] "
+                  "[--dispatch-stats] [--scan-stats] [--scanner=scalar|sse2|avx2] [--max-depth=calls] "
+                  "[filename]",
+                  std::cerr);
     return exit::usage;
 }
 
@@ -68,19 +85,22 @@ void ps1()
 
 int Driver::runFile(const std::string &path)
 {
-    std::ifstream file{path, std::ios::binary};
-    if (file.fail()) {
+    SourceManager manager;
+    std::optional<Source::Id> id = manager.loadFile(path);
+    if (!id) {
         io::writeLine("Can't read file: " + path, std::cerr);
         return exit::failure;
     }
-    std::string buffer;
-    io::read(buffer, file);
 
-    run(buffer, path);
+    run(manager.getSource(*id).text(), manager.getPath(*id));
+    reportStats();
 
     if (hadError) {
         return exit::dataerr;
     }
+    if (hadRuntimeError) {
+        return exit::software;
+    }
 
     return exit::success;
 }
@@ -92,10 +112,12 @@ int Driver::runPrompt()
     std::string line;
     while (true) {
         hadError = false;  // reset error status
+        hadRuntimeError = false;
         ps1();
         io::readLine(line, std::cin);
         if (std::cin.eof()) {
             io::writeLine("");
+            reportStats();
             break;
         }
         run(line);
@@ -103,19 +125,21 @@ int Driver::runPrompt()
     return exit::success;
 }
 
-void Driver::run(const std::string& buffer, const std::string &path)
+void Driver::run(std::string_view source, const std::string &path)
 {
-    SourceManager manager;
-    auto id = manager.makeSource(buffer, path);
-
     if (!path.empty()) {
-        io::writeColoredLine("-- " + manager.getPath(id));
+        io::writeColoredLine("-- " + path);
     }
 
-    Lexer lexer{buffer};
+    auto scanStart = std::chrono::steady_clock::now();
+    Lexer lexer{source};
     std::vector<Token> tokens = lexer.scanTokens();
+    scanned.bytes += source.size();
+    scanned.tokens += tokens.size();
+    scanned.time += std::chrono::steady_clock::now() - scanStart;
 
-    Parser parser{tokens};
+    auto arena = std::make_unique<memory::Arena>();
+    Parser parser{tokens, *arena};
     std::vector<Stmt *> statements = parser.parse();
     if (hadError) {
         return;
@@ -127,9 +151,72 @@ void Driver::run(const std::string& buffer, const std::string &path)
     }
 
     static Interpreter interpreter;
-    static Resolver resolver{&interpreter};
+    static Resolver resolver;
     resolver.resolve(statements);
-    interpreter.interpret(statements);
+    if (hadError) {
+        return;
+    }
+
+    if (engine == Engine::Tree) {
+        interpreter.maxDepth = maxDepth;
+        interpreter.interpret(statements);
+        syntaxTrees.push_back(std::move(arena));
+        return;
+    }
+
+    if (engine == Engine::Register) {
+        RegisterCompiler compiler;
+        object::PrototypePtr script = compiler.compile(statements);
+        if (hadError) {
+            return;
+        }
+        object::Roots roots;
+        roots.add(script);
+        static RegisterVM vm;
+        vm.maxDepth = maxDepth;
+        vm.interpret(script);
+        return;
+    }
+
+    Compiler compiler;
+    object::PrototypePtr script = compiler.compile(statements);
+    if (hadError) {
+        return;
+    }
+    // Nothing refers to the script until the VM has made a closure of it
+    object::Roots roots;
+    roots.add(script);
+    static VM vm;
+    vm.maxDepth = maxDepth;
+    vm.interpret(script);
+}
+
+void Driver::reportStats()
+{
+    if (heapStats) {
+        io::writeLine(object::heap().report(), std::cerr);
+    }
+    if (cacheStats) {
+        io::writeLine(object::InlineCache::report(), std::cerr);
+    }
+    if (dispatchStats) {
+#ifdef DRAFT_DISPATCH_STATS
+        io::writeLine("dispatched " + std::to_string(dispatched) + " instructions", std::cerr);
+#else
+        io::writeLine("dispatched instructions are only counted when built with DRAFT_DISPATCH_STATS", std::cerr);
+#endif
+    }
+    if (scanStats) {
+        auto time = std::chrono::duration_cast<std::chrono::microseconds>(scanned.time).count();
+        // Bytes per microsecond are megabytes per second
+        auto throughput = time ? scanned.bytes / time : 0;
+        io::writeLine("scanner: " + std::string{scan::scanner().name} +
+                      "\nbytes scanned: " + std::to_string(scanned.bytes) +
+                      "\ntokens: " + std::to_string(scanned.tokens) +
+                      "\nscan time: " + std::to_string(time) + "us" +
+                      "\nthroughput: " + std::to_string(throughput) + " MB/s",
+                      std::cerr);
+    }
 }
 
 void Driver::error(std::size_t line, const std::string &message)
@@ -138,6 +225,12 @@ void Driver::error(std::size_t line, const std::string &message)
     hadError = true;
 }
 
+void Driver::runtimeError(std::size_t line, const std::string &message)
+{
+    report(line, "", message);
+    hadRuntimeError = true;
+}
+
 void Driver::report(std::size_t line, const std::string &where, const std::string &message)
 {
     io::writeLine("[line " + std::to_string(line) + "] Error " + where + ": " + message, std::cerr);
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <vector>
 
+#include "arena.h"
 #include "interpreter.h"
 
 namespace draft {
@@ -24,6 +28,9 @@ void writeColoredLine(const std::string &line);
 
 class Driver {
 public:
+    // Execution engines; the tree-walker is kept to cross-check the VMs
+    enum class Engine { Stack, Register, Tree };
+
     static int usage();
 
     static int runFile(const std::string &path);
@@ -31,12 +38,41 @@ public:
     static int runPrompt();
 
     static void error(std::size_t line, const std::string &message);
+    static void runtimeError(std::size_t line, const std::string &message);
     static void report(std::size_t line, const std::string &where, const std::string &message);
 
-    static void run(const std::string& buffer, const std::string &path = "");
+    // Runs source, which has to stay where it is until it is done
+    static void run(std::string_view source, const std::string &path = "");
+    static void reportStats();
+
+    static Engine engine;
+    // Print collector statistics when the program is done
+    static bool heapStats;
+    // Print inline cache statistics when the program is done
+    static bool cacheStats;
+    // Print the number of instructions the VMs dispatched when the program is done
+    static bool dispatchStats;
+    // Instructions dispatched so far, only counted in builds with DRAFT_DISPATCH_STATS
+    static std::size_t dispatched;
+    // Print how fast the lexer went when the program is done
+    static bool scanStats;
+    // How deep every engine lets calls nest
+    static std::size_t maxDepth;
 
 private:
+    // Bytes scanned so far, the tokens they made and the time it took
+    struct Scanned {
+        std::size_t bytes = 0;
+        std::size_t tokens = 0;
+        std::chrono::steady_clock::duration time{};
+    };
+    static Scanned scanned;
+    // Syntax trees the tree-walker ran. Its functions run their declarations, which later lines of
+    // the REPL may call, so the trees are kept for as long as the program runs
+    static std::vector<std::unique_ptr<memory::Arena>> syntaxTrees;
+
     static bool hadError;
+    static bool hadRuntimeError;
 };
 
 }  // namespace draft
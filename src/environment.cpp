@@ -1,60 +1,61 @@
 #include "environment.h"
 
-#include "parser.h"
+#include "heap.h"
+#include "obj_closure.h"
 
 namespace draft {
 
-Environment::Environment(EnvironmentPtr enclosing)
-    : enclosing{enclosing}
+Environment::Environment()
+    : Obj{Kind::Environment}
 {
 }
 
-void Environment::define(const std::string &name, const object::Object &value)
+void Environment::trace(object::Heap &heap)
 {
-    values[name] = value;
+    for (const object::Value &value : values) {
+        heap.mark(value);
+    }
 }
 
-object::Object Environment::get(Token name)
+void Environment::define(const object::Value &value)
 {
-    if (values.contains(name.lexeme)) {
-        return values.at(name.lexeme);
-    }
-    if (enclosing) {
-        return enclosing->get(name);
-    }
-    throw RuntimeError{name, "Undefined variable '" + name.lexeme + ";"};
+    values.push_back(value);
 }
 
-object::Object Environment::getAt(int distance, std::string name)
+void Environment::box(int slot)
 {
-    return ancestor(distance)->values.at(name);
+    auto *cell = object::make<object::Upvalue>(values[slot]);
+    values[slot] = cell;
 }
 
-EnvironmentPtr Environment::ancestor(int distance)
+void Environment::initialize(const object::Value &value)
 {
-    EnvironmentPtr env = shared_from_this();
-    for (int i = 0; i < distance; i++) {
-        env = env->enclosing;
+    object::Value &variable = values.back();
+    if (variable.isObj() and variable.asObj()->kind == Kind::Upvalue) {
+        static_cast<object::Upvalue *>(variable.asObj())->closed = value;
+    } else {
+        variable = value;
     }
-    return env;
 }
 
-void Environment::assign(const Token &name, const object::Object &value)
+void Environment::truncate(std::size_t size)
 {
-    if (values.contains(name.lexeme)) {
-        values[name.lexeme] = value;
-        return;
-    }
-    if (enclosing) {
-        enclosing->assign(name, value);
-        return;
-    }
-    throw RuntimeError{name, "Undefined variable '" + name.lexeme + "'"};
+    values.resize(size);
+}
+
+void Environment::reset()
+{
+    values.clear();
+}
+
+object::Upvalue *Environment::cellAt(int slot) const
+{
+    return static_cast<object::Upvalue *>(values[slot].asObj());
 }
 
-void Environment::assignAt(int distance, const Token &name, const object::Object &value)
+std::size_t Environment::size() const
 {
-    ancestor(distance)->values[name.lexeme] = value;
+    return values.size();
 }
 
 }  // namespace draft
@@ -2,31 +2,50 @@
 
 #include "object.h"
 
-#include <map>
-#include <memory>
-
-#include "token.h"
+#include <vector>
 
 namespace draft {
+namespace object {
+class Upvalue;
+}
 
 class Environment;
-using EnvironmentPtr = std::shared_ptr<Environment>;
+using EnvironmentPtr = Environment *;
 
-class Environment : public std::enable_shared_from_this<Environment> {
+// Local variables of one call. The Resolver lays out the scopes of a function as consecutive
+// slots of its frame: a block's variables take the slots after those of the scopes around it and
+// are dropped when it ends. Closures keep the variables they capture in cells of their own, so a
+// frame never outlives its call. Globals are not resolved and live in the Interpreter
+class Environment : public object::Obj {
 public:
-    Environment() = default;
-    explicit Environment(EnvironmentPtr enclosing);
-    void define(const std::string &name, const object::Object &value);
-
-    object::Object get(Token name);
-    object::Object getAt(int distance, std::string name);
-    EnvironmentPtr ancestor(int distance);
-    void assign(const Token &name, const object::Object &value);
-    void assignAt(int distance, const Token &name, const object::Object &value);
+    Environment();
+
+    void trace(object::Heap &heap) override;
+
+    // Declarations run in the order the Resolver numbered them, the next one takes the next slot
+    void define(const object::Value &value);
+    // Moves the variable in slot into a new cell, for closures to share
+    void box(int slot);
+    // Stores value into the variable defined last, or into its cell
+    void initialize(const object::Value &value);
+    // Drops the variables of a scope that ended, keeping the first size slots
+    void truncate(std::size_t size);
+    // Empties the frame so it can be used again for another call, keeping the storage of its slots
+    void reset();
+
+    const object::Value &get(int slot) const
+    {
+        return values[slot];
+    }
+    void assign(int slot, const object::Value &value)
+    {
+        values[slot] = value;
+    }
+    object::Upvalue *cellAt(int slot) const;
+    std::size_t size() const;
 
-    EnvironmentPtr enclosing = nullptr;
 private:
-    std::map<std::string, object::Object> values;
+    std::vector<object::Value> values;
 };
 
 }  // namespace draft
@@ -0,0 +1,158 @@
+#include "heap.h"
+
+#include <algorithm>
+
+namespace draft::object {
+
+void Heap::adopt(Obj *obj, std::size_t size)
+{
+    obj->size = static_cast<std::uint32_t>(size);
+    obj->next = objects;
+    objects = obj;
+
+    liveBytes += size;
+    statistics.objectsAllocated++;
+    statistics.bytesAllocated += size;
+    statistics.peakBytes = std::max(statistics.peakBytes, liveBytes);
+
+    if (options.stress or liveBytes > nextCollection) {
+        // Nothing refers to the new object yet, but whatever it was built from may only be
+        // reachable through it
+        Roots roots;
+        roots.add(obj);
+        collect();
+    }
+}
+
+void Heap::addRoots(RootSet *roots)
+{
+    rootSets.push_back(roots);
+}
+
+void Heap::removeRoots(RootSet *roots)
+{
+    std::erase(rootSets, roots);
+}
+
+void Heap::pin(Obj *obj)
+{
+    obj->pinned = true;
+}
+
+void Heap::mark(Obj *obj)
+{
+    if (!obj or obj->marked or obj->pinned) {
+        return;
+    }
+    obj->marked = true;
+    gray.push_back(obj);
+}
+
+void Heap::mark(const Value &value)
+{
+    if (value.isObj()) {
+        mark(value.asObj());
+    }
+}
+
+void Heap::collect()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    markRoots();
+    traceReferences();
+    sweep();
+
+    nextCollection = std::max(static_cast<std::size_t>(liveBytes * options.growthFactor), options.initialThreshold);
+    statistics.collections++;
+    statistics.pauseTime += std::chrono::steady_clock::now() - start;
+}
+
+void Heap::configure(const Options &options)
+{
+    this->options = options;
+    nextCollection = std::max(nextCollection, options.initialThreshold);
+}
+
+const Heap::Stats &Heap::stats() const
+{
+    return statistics;
+}
+
+std::size_t Heap::bytesInUse() const
+{
+    return liveBytes;
+}
+
+std::string Heap::report() const
+{
+    auto pause = std::chrono::duration_cast<std::chrono::microseconds>(statistics.pauseTime).count();
+    return "collections: " + std::to_string(statistics.collections) +
+           "\nobjects allocated: " + std::to_string(statistics.objectsAllocated) +
+           "\nobjects freed: " + std::to_string(statistics.objectsFreed) +
+           "\nbytes allocated: " + std::to_string(statistics.bytesAllocated) +
+           "\nbytes freed: " + std::to_string(statistics.bytesFreed) +
+           "\nbytes in use: " + std::to_string(liveBytes) +
+           "\npeak bytes: " + std::to_string(statistics.peakBytes) +
+           "\npause time: " + std::to_string(pause) + "us";
+}
+
+void Heap::markRoots()
+{
+    for (RootSet *roots : rootSets) {
+        roots->markRoots(*this);
+    }
+    for (const Value &value : temporaries) {
+        mark(value);
+    }
+}
+
+void Heap::traceReferences()
+{
+    while (!gray.empty()) {
+        Obj *obj = gray.back();
+        gray.pop_back();
+        obj->trace(*this);
+    }
+}
+
+void Heap::sweep()
+{
+    Obj **link = &objects;
+    while (Obj *obj = *link) {
+        if (obj->marked or obj->pinned) {
+            obj->marked = false;
+            link = &obj->next;
+            continue;
+        }
+        *link = obj->next;
+        liveBytes -= obj->size;
+        statistics.objectsFreed++;
+        statistics.bytesFreed += obj->size;
+        delete obj;
+    }
+}
+
+Heap &heap()
+{
+    // Never destroyed, root sets with static storage unregister after it would have been
+    static auto *heap = new Heap;
+    return *heap;
+}
+
+Roots::Roots()
+    : base{heap().temporaries.size()}
+{
+}
+
+Roots::~Roots()
+{
+    heap().temporaries.resize(base);
+}
+
+void Roots::add(const Value &value)
+{
+    heap().temporaries.push_back(value);
+}
+
+}  // namespace draft::object
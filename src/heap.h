@@ -0,0 +1,112 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "object.h"
+
+namespace draft::object {
+
+// Owner of references the collector can't discover by tracing, such as an engine's stack and
+// globals. Root sets register with the heap for as long as they exist
+class RootSet {
+public:
+    virtual ~RootSet() = default;
+    virtual void markRoots(Heap &heap) = 0;
+};
+
+// Owns every Obj and frees the unreachable ones with a precise mark-sweep collection. The roots
+// are the registered root sets, the temporaries held through Roots and the pinned objects
+class Heap {
+public:
+    struct Options {
+        // After a collection the next one is due once the live bytes have grown by this factor
+        double growthFactor = 2.0;
+        std::size_t initialThreshold = 1024 * 1024;
+        // Collects on every allocation to flush out missing roots
+        bool stress = false;
+    };
+
+    struct Stats {
+        std::size_t collections = 0;
+        std::size_t objectsAllocated = 0;
+        std::size_t objectsFreed = 0;
+        std::size_t bytesAllocated = 0;
+        std::size_t bytesFreed = 0;
+        std::size_t peakBytes = 0;
+        std::chrono::nanoseconds pauseTime{0};
+    };
+
+    Heap() = default;
+    Heap(const Heap &) = delete;
+    Heap &operator=(const Heap &) = delete;
+
+    template <typename T, typename... Args>
+    T *make(Args &&...args)
+    {
+        T *obj = new T{std::forward<Args>(args)...};
+        adopt(obj, sizeof(T));
+        return obj;
+    }
+    // Takes ownership of a new object, accounted as size bytes. May collect before returning
+    void adopt(Obj *obj, std::size_t size);
+
+    void addRoots(RootSet *roots);
+    void removeRoots(RootSet *roots);
+    // Keeps obj alive for good. Pinned objects are not traced, so only leaves such as strings
+    // may be pinned
+    void pin(Obj *obj);
+
+    void mark(Obj *obj);
+    void mark(const Value &value);
+
+    void collect();
+
+    void configure(const Options &options);
+    const Stats &stats() const;
+    std::size_t bytesInUse() const;
+    std::string report() const;
+
+private:
+    friend class Roots;
+
+    void markRoots();
+    void traceReferences();
+    void sweep();
+
+    Options options;
+    Stats statistics;
+    Obj *objects = nullptr;
+    std::size_t liveBytes = 0;
+    std::size_t nextCollection = Options{}.initialThreshold;
+
+    std::vector<RootSet *> rootSets;
+    std::vector<Value> temporaries;
+    std::vector<Obj *> gray;
+};
+
+Heap &heap();
+
+template <typename T, typename... Args>
+T *make(Args &&...args)
+{
+    return heap().make<T>(std::forward<Args>(args)...);
+}
+
+// Keeps values that are only held by C++ locals reachable until the end of the scope
+class Roots {
+public:
+    Roots();
+    ~Roots();
+    Roots(const Roots &) = delete;
+    Roots &operator=(const Roots &) = delete;
+
+    void add(const Value &value);
+
+private:
+    std::size_t base;
+};
+
+}  // namespace draft::object
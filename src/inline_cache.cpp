@@ -0,0 +1,37 @@
+#include "inline_cache.h"
+
+namespace draft::object {
+
+InlineCache::Stats InlineCache::statistics;
+
+void InlineCache::add(const Shape *shape, Entry entry)
+{
+    if (megamorphic) {
+        return;
+    }
+    if (count == Capacity) {
+        megamorphic = true;
+        ++statistics.megamorphic;
+        return;
+    }
+    if (count == 1) {
+        ++statistics.polymorphic;
+    }
+    entry.shape = shape->id;
+    entries[count++] = entry;
+}
+
+const InlineCache::Stats &InlineCache::stats()
+{
+    return statistics;
+}
+
+std::string InlineCache::report()
+{
+    return "inline cache hits: " + std::to_string(statistics.hits) +
+           "\ninline cache misses: " + std::to_string(statistics.misses) +
+           "\npolymorphic sites: " + std::to_string(statistics.polymorphic) +
+           "\nmegamorphic sites: " + std::to_string(statistics.megamorphic);
+}
+
+}  // namespace draft::object
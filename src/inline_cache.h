@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "obj_callable.h"
+#include "obj_shape.h"
+
+namespace draft::object {
+
+// Remembers what a property access or call site found for the shapes it has seen, so that later
+// visits skip the lookups. A site is monomorphic while it has seen one shape and polymorphic up to
+// Capacity shapes. Past that it is megamorphic and stops caching
+class InlineCache {
+public:
+    static constexpr std::size_t Capacity = 4;
+
+    // What the site found for one shape, the members used depend on the kind of site:
+    //   get   the field at offset, or method if the name isn't a field
+    //   set   the field at offset, or if next is set, a new field that moves the instance to next
+    //   call  the initializer of the class owning the root shape, null if it has none
+    struct Entry {
+        std::uint64_t shape = 0;  // Shape::id
+        std::uint32_t offset = 0;
+        MethodPtr method = nullptr;
+        ShapePtr next = nullptr;
+    };
+
+    struct Stats {
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+        std::size_t polymorphic = 0;  // sites that have seen a second shape
+        std::size_t megamorphic = 0;  // sites that have given up caching
+    };
+
+    // Null on a miss. Counted in stats()
+    const Entry *find(const Shape *shape)
+    {
+        for (std::uint8_t i = 0; i < count; ++i) {
+            if (entries[i].shape == shape->id) {
+                ++statistics.hits;
+                return &entries[i];
+            }
+        }
+        ++statistics.misses;
+        return nullptr;
+    }
+    void add(const Shape *shape, Entry entry);
+
+    static const Stats &stats();
+    static std::string report();
+
+private:
+    static Stats statistics;
+
+    std::array<Entry, Capacity> entries;
+    std::uint8_t count = 0;
+    bool megamorphic = false;
+};
+
+}  // namespace draft::object
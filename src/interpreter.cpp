@@ -9,342 +9,1110 @@
 
 namespace draft {
 
+// Nodes that cannot suspend are evaluated on the native stack, as deep as the source nests them.
+// Inlined into every node that evaluates its operands, so each of them switches on their kinds
+// with an indirect branch of its own, which predicts far better than a shared one
+inline object::Value Interpreter::evaluate(Expr *expr)
+{
+    if (!expr) {
+        return object::Null{};
+    }
+    switch (expr->kind) {
+    case Expr::Kind::Literal:
+        return static_cast<Literal *>(expr)->value;
+    case Expr::Kind::Logical:
+        return evaluate(static_cast<Logical *>(expr));
+    case Expr::Kind::Unary:
+        return evaluate(static_cast<Unary *>(expr));
+    case Expr::Kind::Binary:
+        return evaluate(static_cast<Binary *>(expr));
+    case Expr::Kind::Grouping:
+        return evaluate(static_cast<Grouping *>(expr)->expression);
+    case Expr::Kind::Variable: {
+        // Locals are read in place, the rest of the lookup is out of line
+        auto *variable = static_cast<Variable *>(expr);
+        if (variable->location.kind == Location::Kind::Local) {
+            return environment->get(variable->location.slot);
+        }
+        return lookUpVariable(variable->name, variable->location);
+    }
+    case Expr::Kind::Assign:
+        return evaluate(static_cast<Assign *>(expr));
+    case Expr::Kind::Get:
+        return evaluate(static_cast<Get *>(expr));
+    case Expr::Kind::Set:
+        return evaluate(static_cast<Set *>(expr));
+    case Expr::Kind::Super:
+        return super(static_cast<Super *>(expr));
+    case Expr::Kind::This: {
+        auto *self = static_cast<This *>(expr);
+        return lookUpVariable(self->keyword, self->location);
+    }
+    case Expr::Kind::Call:
+        // Always suspends
+        break;
+    }
+
+    // Unreachable
+    return object::Null{};
+}
+
+inline void Interpreter::execute(Stmt *stmt)
+{
+    if (!stmt) {
+        return;
+    }
+    switch (stmt->kind) {
+    case Stmt::Kind::ExprStmt:
+        evaluate(static_cast<ExprStmt *>(stmt)->expression);
+        return;
+    case Stmt::Kind::If: {
+        auto *branch = static_cast<If *>(stmt);
+        execute(object::isTruthy(evaluate(branch->condition)) ? branch->thenBranch : branch->elseBranch);
+        return;
+    }
+    case Stmt::Kind::FuncStmt:
+        declare(static_cast<FuncStmt *>(stmt));
+        return;
+    case Stmt::Kind::Print:
+        io::writeLine(object::obj2str(evaluate(static_cast<Print *>(stmt)->expression)));
+        return;
+    case Stmt::Kind::While:
+        execute(static_cast<While *>(stmt));
+        return;
+    case Stmt::Kind::Block:
+        execute(static_cast<Block *>(stmt));
+        return;
+    case Stmt::Kind::Class:
+        declare(static_cast<Class *>(stmt));
+        return;
+    case Stmt::Kind::Var: {
+        auto *var = static_cast<Var *>(stmt);
+        define(var->name, evaluate(var->initializer), var->captured);
+        return;
+    }
+    case Stmt::Kind::Return:
+        // Always suspends
+        return;
+    }
+}
+
 Interpreter::Interpreter()
 {
-    globals = std::make_shared<Environment>();
-    globals->define("clock", std::make_shared<ClockFunction>());
-    environment = globals;
+    resetStack();
+    object::heap().addRoots(this);
+    object::Roots roots;
+    auto *clock = object::make<ClockFunction>();
+    roots.add(clock);
+    globals.emplace(object::intern("clock"), clock);
+}
+
+Interpreter::~Interpreter()
+{
+    object::heap().removeRoots(this);
 }
 
 void Interpreter::interpret(const std::vector<Stmt *> &statements)
 {
     try {
         for (Stmt *statement : statements) {
-            execute(statement);
+            if (!begin(statement)) {
+                run(0);
+            }
         }
     } catch (const RuntimeError &err) {
-        Driver::error(err.token.line, err.what());
-        std::exit(draft::exit::software);
+        Driver::runtimeError(err.token.line, err.what());
+        resetStack();
+    }
+}
+
+object::Value Interpreter::call(object::Function *callee, object::Arguments arguments)
+{
+    // The arguments may be on the stack, which can move as they are pushed
+    std::vector<object::Value> values{arguments.begin(), arguments.end()};
+    std::size_t floor = tasks.size();
+    std::size_t base = stack.size();
+    stack.push_back(callee);
+    stack.insert(stack.end(), values.begin(), values.end());
+    if (!enter(callee, base, callee->code()->name)) {
+        run(floor);
     }
+    object::Value result = stack.back();
+    stack.pop_back();
+    return result;
 }
 
-object::Object Interpreter::visit(Literal *expr)
+void Interpreter::markRoots(object::Heap &heap)
 {
-    return expr->value;
+    for (const auto &[name, value] : globals) {
+        heap.mark(name);
+        heap.mark(value);
+    }
+    heap.mark(environment);
+    heap.mark(function);
+    for (const Task &task : tasks) {
+        heap.mark(task.environment);
+        heap.mark(task.function);
+    }
+    for (const object::Value &value : stack) {
+        heap.mark(value);
+    }
+    // Frames beyond frameCount are empty and only kept for reuse
+    for (EnvironmentPtr frame : frames) {
+        heap.mark(frame);
+    }
 }
 
-object::Object Interpreter::visit(Logical *expr)
+void Interpreter::run(std::size_t floor)
 {
-    object::Object left = evaluate(expr->left);
+    while (tasks.size() > floor) {
+        Task &task = tasks.back();
+        if (task.kind == Task::Kind::Call) {
+            if (task.returning) {
+                leave(stack.back());
+            } else {
+                proceed();
+            }
+            continue;
+        }
 
-    if (expr->op.kind == Token::Kind::Or) {
-        if (object::isTruthy(left)) {
-            return left;
+        if (task.kind == Task::Kind::Stmt) {
+            auto *stmt = static_cast<Stmt *>(task.node);
+            switch (stmt->kind) {
+            case Stmt::Kind::ExprStmt:
+                advance(static_cast<ExprStmt *>(stmt), task);
+                break;
+            case Stmt::Kind::If:
+                advance(static_cast<If *>(stmt), task);
+                break;
+            case Stmt::Kind::Print:
+                advance(static_cast<Print *>(stmt), task);
+                break;
+            case Stmt::Kind::Return:
+                advance(static_cast<Return *>(stmt), task);
+                break;
+            case Stmt::Kind::While:
+                advance(static_cast<While *>(stmt), task);
+                break;
+            case Stmt::Kind::Block:
+                advance(static_cast<Block *>(stmt), task);
+                break;
+            case Stmt::Kind::Var:
+                advance(static_cast<Var *>(stmt), task);
+                break;
+            case Stmt::Kind::FuncStmt:
+            case Stmt::Kind::Class:
+                // Declarations never suspend
+                break;
+            }
+            continue;
         }
-    } else {
-        if (!object::isTruthy(left)) {
-            return left;
+
+        auto *expr = static_cast<Expr *>(task.node);
+        switch (expr->kind) {
+        case Expr::Kind::Logical:
+            advance(static_cast<Logical *>(expr), task);
+            break;
+        case Expr::Kind::Unary:
+            advance(static_cast<Unary *>(expr), task);
+            break;
+        case Expr::Kind::Binary:
+            advance(static_cast<Binary *>(expr), task);
+            break;
+        case Expr::Kind::Call:
+            advance(static_cast<Call *>(expr), task);
+            break;
+        case Expr::Kind::Assign:
+            advance(static_cast<Assign *>(expr), task);
+            break;
+        case Expr::Kind::Get:
+            advance(static_cast<Get *>(expr), task);
+            break;
+        case Expr::Kind::Set:
+            advance(static_cast<Set *>(expr), task);
+            break;
+        case Expr::Kind::Literal:
+        case Expr::Kind::Grouping:
+        case Expr::Kind::Variable:
+        case Expr::Kind::Super:
+        case Expr::Kind::This:
+            // Leaves never suspend, and groupings are skipped by begin()
+            break;
         }
     }
-    return evaluate(expr->right);
 }
 
-object::Object Interpreter::visit(Unary *expr)
+bool Interpreter::begin(Expr *expr)
 {
-    object::Object right = evaluate(expr->right);
+    if (!expr or !expr->suspends) {
+        stack.push_back(evaluate(expr));
+        return true;
+    }
+    // A grouping is its expression, however deeply nested
+    while (expr->kind == Expr::Kind::Grouping) {
+        expr = static_cast<Grouping *>(expr)->expression;
+    }
+    if (expr->kind == Expr::Kind::Call) {
+        // With its callee and arguments at hand a call needs no task of its own
+        auto *call = static_cast<Call *>(expr);
+        if (call->ready) {
+            std::size_t base = stack.size();
+            auto *get = call->callee->kind == Expr::Kind::Get ? static_cast<Get *>(call->callee) : nullptr;
+            stack.push_back(evaluate(get ? get->object : call->callee));
+            for (Expr *argument : call->arguments) {
+                stack.push_back(evaluate(argument));
+            }
+            return get ? invoke(call, base) : this->call(call, base);
+        }
+    }
+    tasks.push_back(Task{.kind = Task::Kind::Expr, .node = expr});
+    return false;
+}
 
-    switch (expr->op.kind) {
-    case Token::Kind::HyphenMinus:
-        checkNumberOperand(expr->op, right);
-        return -std::get<object::Number>(right);
-    case Token::Kind::ExclamationMark:
-        return !object::isTruthy(right);
-    default:
-        break;
+bool Interpreter::begin(Stmt *stmt)
+{
+    if (!stmt or !stmt->suspends) {
+        execute(stmt);
+        return true;
     }
+    if (stmt->kind == Stmt::Kind::If) {
+        // With the condition at hand only the branch taken is left
+        auto *branch = static_cast<If *>(stmt);
+        if (!branch->condition->suspends) {
+            return begin(object::isTruthy(evaluate(branch->condition)) ? branch->thenBranch : branch->elseBranch);
+        }
+    }
+    if (stmt->kind == Stmt::Kind::Return) {
+        Expr *value = static_cast<Return *>(stmt)->value;
+        if (!value or !value->suspends) {
+            // The value is at hand, the call returns right away. Its tasks are gone as if the
+            // statement had suspended
+            leave(evaluate(value));
+            return false;
+        }
+        if (tasks.back().kind == Task::Kind::Call) {
+            // Right in the body, the call itself returns the value once it is done
+            tasks.back().returning = true;
+            if (begin(value)) {
+                leave(stack.back());
+            }
+            return false;
+        }
+    }
+    tasks.push_back(Task{.kind = Task::Kind::Stmt, .node = stmt});
+    return false;
+}
 
-    // Unreachable
-    return object::Null{};
+// A node bumps its step before it begins a child, as a child that suspends moves the task. The
+// children that are done with right away fall through to the next step
+
+void Interpreter::advance(Logical *expr, Task &task)
+{
+    if (task.step++ == 0 and !begin(expr->left)) {
+        return;
+    }
+
+    const object::Value &left = stack.back();
+    bool decided = expr->op.kind == Token::Kind::Or ? object::isTruthy(left) : !object::isTruthy(left);
+    tasks.pop_back();
+    if (!decided) {
+        // The right operand is the value of the whole expression
+        stack.pop_back();
+        begin(expr->right);
+    }
 }
 
-object::Object Interpreter::visit(Binary *expr)
+void Interpreter::advance(Unary *expr, Task &task)
 {
-    object::Object left = evaluate(expr->left);
-    object::Object right = evaluate(expr->right);
+    if (task.step++ == 0 and !begin(expr->right)) {
+        return;
+    }
+    tasks.pop_back();
+    stack.back() = unary(expr, stack.back());
+}
 
-    switch (expr->op.kind) {
-    case Token::Kind::GreaterThanSign:
-        checkNumberOperands(expr->op, left, right);
-        return std::get<object::Number>(left) > std::get<object::Number>(right);
-    case Token::Kind::GreaterEqual:
-        checkNumberOperands(expr->op, left, right);
-        return std::get<object::Number>(left) >= std::get<object::Number>(right);
-    case Token::Kind::LessThanSign:
-        checkNumberOperands(expr->op, left, right);
-        return std::get<object::Number>(left) < std::get<object::Number>(right);
-    case Token::Kind::LessEqual:
-        checkNumberOperands(expr->op, left, right);
-        return std::get<object::Number>(left) <= std::get<object::Number>(right);
-    case Token::Kind::ExclaimEqual:
-        return !object::isEqual(left, right);
-    case Token::Kind::EqualEqual:
-        return object::isEqual(left, right);
-    case Token::Kind::HyphenMinus:
-        checkNumberOperands(expr->op, left, right);
-        return std::get<object::Number>(left) - std::get<object::Number>(right);
-    case Token::Kind::PlusSign:
-        if (std::holds_alternative<object::Number>(left) and std::holds_alternative<object::Number>(right)) {
-            return std::get<object::Number>(left) + std::get<object::Number>(right);
+void Interpreter::advance(Binary *expr, Task &task)
+{
+    switch (task.step) {
+    case 0:
+        ++task.step;
+        if (!begin(expr->left)) {
+            return;
         }
-        if (std::holds_alternative<object::String>(left) and std::holds_alternative<object::String>(right)) {
-            return std::get<object::String>(left) + std::get<object::String>(right);
+        [[fallthrough]];
+    case 1:
+        ++task.step;
+        if (!begin(expr->right)) {
+            return;
         }
-        throw RuntimeError{expr->op, "Operands must be two numbers or two strings"};
-    case Token::Kind::Solidus:
-        checkNumberOperands(expr->op, left, right);
-        return std::get<object::Number>(left) / std::get<object::Number>(right);
-    case Token::Kind::Asterisk:
-        checkNumberOperands(expr->op, left, right);
-        return std::get<object::Number>(left) * std::get<object::Number>(right);
+        break;
     default:
         break;
     }
+    tasks.pop_back();
 
-    // Unreachable
-    return object::Null{};
+    // Both operands stay on the stack until the result replaces them, concatenation allocates
+    object::Value result = binary(expr, stack[stack.size() - 2], stack.back());
+    stack.pop_back();
+    stack.back() = result;
+}
+
+void Interpreter::advance(Call *expr, Task &task)
+{
+    // The callee and the arguments are kept on the stack, which roots them. A method is invoked on
+    // the receiver in place of the callee, see invoke()
+    auto *get = expr->callee->kind == Expr::Kind::Get ? static_cast<Get *>(expr->callee) : nullptr;
+    std::size_t argCount = expr->arguments.size();
+    if (task.step == 0) {
+        ++task.step;
+        if (!begin(get ? get->object : expr->callee)) {
+            return;
+        }
+    }
+    while (task.step <= argCount) {
+        if (!begin(expr->arguments[task.step++ - 1])) {
+            return;
+        }
+    }
+    tasks.pop_back();
+    std::size_t base = stack.size() - argCount - 1;
+    if (get) {
+        invoke(expr, base);
+    } else {
+        call(expr, base);
+    }
 }
 
-object::Object Interpreter::visit(Call *expr)
+void Interpreter::advance(Assign *expr, Task &task)
 {
-    object::Object callee = evaluate(expr->callee);
+    if (task.step++ == 0 and !begin(expr->value)) {
+        return;
+    }
+    // The assigned value stays on the stack as the value of the expression
+    assignVariable(expr->name, expr->location, stack.back());
+    tasks.pop_back();
+}
 
-    std::vector<object::Object> arguments;
-    for (Expr *argument : expr->arguments) {
-        arguments.emplace_back(evaluate(argument));
+void Interpreter::advance(Get *expr, Task &task)
+{
+    if (task.step++ == 0 and !begin(expr->object)) {
+        return;
     }
+    tasks.pop_back();
+    // Kept on the stack until the property replaces it, binding a method allocates
+    stack.back() = property(expr, stack.back());
+}
 
-    if (!std::holds_alternative<object::CallablePtr>(callee)) {
-        throw RuntimeError{expr->paren, "Can only call functions and classes"};
+void Interpreter::advance(Set *expr, Task &task)
+{
+    switch (task.step) {
+    case 0:
+        ++task.step;
+        if (!begin(expr->object)) {
+            return;
+        }
+        [[fallthrough]];
+    case 1:
+        ++task.step;
+        if (!stack.back().isInstance()) {
+            throw RuntimeError{expr->name, "Only instances have fields"};
+        }
+        if (!begin(expr->value)) {
+            return;
+        }
+        break;
+    default:
+        break;
     }
-    auto function = std::get<object::CallablePtr>(callee);
-    if (arguments.size() != function->arity()) {
-        throw RuntimeError{
-            expr->paren,
-            "Expected " + std::to_string(function->arity()) + " arguments but got " + std::to_string(arguments.size())};
+    tasks.pop_back();
+
+    // Both stay on the stack while the instance may allocate a shape
+    object::Value value = stack.back();
+    stack[stack.size() - 2].asInstance()->setProperty(expr->name.symbol(), value, expr->cache);
+    stack.pop_back();
+    stack.back() = value;
+}
+
+void Interpreter::advance(ExprStmt *stmt, Task &task)
+{
+    if (task.step++ == 0 and !begin(stmt->expression)) {
+        return;
     }
-    return function->call(this, arguments);
+    stack.pop_back();
+    tasks.pop_back();
 }
 
-object::Object Interpreter::visit(Grouping *expr)
+void Interpreter::advance(If *stmt, Task &task)
 {
-    return evaluate(expr->expression);
+    if (task.step++ == 0 and !begin(stmt->condition)) {
+        return;
+    }
+    bool condition = object::isTruthy(stack.back());
+    stack.pop_back();
+    tasks.pop_back();
+    begin(condition ? stmt->thenBranch : stmt->elseBranch);
 }
 
-object::Object Interpreter::visit(Variable *expr)
+void Interpreter::advance(Print *stmt, Task &task)
 {
-    return lookUpVariable(expr->name, expr);
+    if (task.step++ == 0 and !begin(stmt->expression)) {
+        return;
+    }
+    io::writeLine(object::obj2str(stack.back()));
+    stack.pop_back();
+    tasks.pop_back();
 }
 
-object::Object Interpreter::visit(Assign *expr)
+void Interpreter::advance(Return *stmt, Task &task)
 {
-    object::Object value = evaluate(expr->value);
-    if (auto it = locals.find(expr); it != locals.end()) {
-        int distance = locals.at(expr);
-        environment->assignAt(distance, expr->name, value);
-    } else {
-        globals->assign(expr->name, value);
+    if (task.step++ == 0 and !begin(stmt->value)) {
+        return;
     }
-    return value;
+    object::Value result = stack.back();
+    stack.pop_back();
+    leave(result);
 }
 
-object::Object Interpreter::visit(Get *expr)
+void Interpreter::advance(While *stmt, Task &task)
 {
-    auto obj = evaluate(expr->object);
-    if (std::holds_alternative<object::InstancePtr>(obj)) {
-        auto instance = std::get<object::InstancePtr>(obj);
-        return instance->getProperty(expr->name.lexeme);
+    while (true) {
+        if (task.step == 0) {
+            task.step = 1;
+            if (!begin(stmt->condition)) {
+                return;
+            }
+        }
+        bool condition = object::isTruthy(stack.back());
+        stack.pop_back();
+        if (!condition) {
+            tasks.pop_back();
+            return;
+        }
+        task.step = 0;
+        if (!begin(stmt->body)) {
+            return;
+        }
     }
-    throw RuntimeError{expr->name, "Only instances have properties"};
 }
 
-object::Object Interpreter::visit(Set *expr)
+void Interpreter::advance(Block *stmt, Task &task)
 {
-    auto obj = evaluate(expr->object);
+    if (task.step == 0) {
+        if (!environment) {
+            // At the top level a block needs a frame of its own
+            environment = pushFrame();
+            task.ownsFrame = true;
+        }
+        // Elsewhere its variables take the next slots of the current frame and are dropped at the end
+        task.base = environment->size();
+    }
+    while (task.step < stmt->statements.size()) {
+        if (!begin(stmt->statements[task.step++])) {
+            return;
+        }
+    }
 
-    if (!std::holds_alternative<object::InstancePtr>(obj)) {
-        throw RuntimeError{expr->name, "Only instances have fields"};
+    if (task.ownsFrame) {
+        popFrame();
+        environment = nullptr;
+    } else {
+        environment->truncate(task.base);
     }
+    tasks.pop_back();
+}
 
-    auto value = evaluate(expr->value);
-    auto instance = std::get<object::InstancePtr>(obj);
-    instance->setProperty(expr->name.lexeme, value);
-    return value;
+void Interpreter::advance(Var *stmt, Task &task)
+{
+    if (task.step++ == 0 and !begin(stmt->initializer)) {
+        return;
+    }
+    define(stmt->name, stack.back(), stmt->captured);
+    stack.pop_back();
+    tasks.pop_back();
 }
 
-object::Object Interpreter::visit(Super *expr)
+object::Value Interpreter::unary(Unary *expr, const object::Value &right)
 {
-    int distance = locals.at(expr);
-    auto superclassObj = environment->getAt(distance, "super");
-    object::Callable *superclassCallable = std::get<object::CallablePtr>(superclassObj).get();
-    object::Class *superclass = dynamic_cast<object::Class *>(superclassCallable);
-    auto instanceObj = environment->getAt(distance - 1, "this");
-    object::InstancePtr instance = std::get<object::InstancePtr>(instanceObj);
-    auto method = superclass->findMethod(expr->method.lexeme);
-    if (!method) {
-        Driver::error(expr->method.line, "Undefined property '" + expr->method.lexeme + "'");
+    if (expr->op.kind == Token::Kind::HyphenMinus) {
+        checkNumberOperand(expr->op, right);
+        return -right.asNumber();
     }
-    return method->bind(instance);
+    return !object::isTruthy(right);
 }
 
-object::Object Interpreter::visit(This *expr)
+inline object::Value Interpreter::binary(Binary *expr, const object::Value &left, const object::Value &right)
 {
-    return lookUpVariable(expr->keyword, expr);
+    using Specialization = Binary::Specialization;
+
+    if (expr->specialization == Specialization::Generic or !left.isNumber() or !right.isNumber()) {
+        expr->specialization = Specialization::Generic;
+        return binary(expr->op, left, right);
+    }
+    double a = left.asNumber();
+    double b = right.asNumber();
+    switch (expr->specialization) {
+    case Specialization::NumberAdd:
+        return a + b;
+    case Specialization::NumberSubtract:
+        return a - b;
+    case Specialization::NumberMultiply:
+        return a * b;
+    case Specialization::NumberDivide:
+        return a / b;
+    case Specialization::NumberGreater:
+        return a > b;
+    case Specialization::NumberGreaterEqual:
+        return a >= b;
+    case Specialization::NumberLess:
+        return a < b;
+    case Specialization::NumberLessEqual:
+        return a <= b;
+    case Specialization::NumberEqual:
+        return a == b;
+    case Specialization::NumberNotEqual:
+        return a != b;
+    case Specialization::Uninitialized:
+        expr->specialization = specializeOnNumbers(expr->op.kind);
+        break;
+    case Specialization::Generic:
+        break;
+    }
+    return binary(expr->op, left, right);
 }
 
-void Interpreter::visit(ExprStmt *stmt)
+object::Value Interpreter::evaluate(Logical *expr)
 {
-    evaluate(stmt->expression);
+    object::Value left = evaluate(expr->left);
+    bool decided = expr->op.kind == Token::Kind::Or ? object::isTruthy(left) : !object::isTruthy(left);
+    return decided ? left : evaluate(expr->right);
 }
 
-void Interpreter::visit(If *stmt)
+object::Value Interpreter::evaluate(Unary *expr)
 {
-    if (object::isTruthy(evaluate(stmt->condition))) {
-        execute(stmt->thenBranch);
-    } else if (stmt->elseBranch) {
-        execute(stmt->elseBranch);
+    return unary(expr, evaluate(expr->right));
+}
+
+object::Value Interpreter::evaluate(Binary *expr)
+{
+    object::Value left = evaluate(expr->left);
+    if (!left.isObj()) {
+        return binary(expr, left, evaluate(expr->right));
     }
+    // Rooted on the stack while the right operand runs
+    stack.push_back(left);
+    object::Value right = evaluate(expr->right);
+    object::Value result = binary(expr, left, right);
+    stack.pop_back();
+    return result;
 }
 
-void Interpreter::visit(FuncStmt *stmt)
+object::Value Interpreter::evaluate(Assign *expr)
 {
-    auto function = std::make_shared<object::Function>(stmt, environment, false);
-    environment->define(stmt->name.lexeme, function);
+    object::Value value = evaluate(expr->value);
+    assignVariable(expr->name, expr->location, value);
+    return value;
 }
 
-void Interpreter::visit(Print *stmt)
+object::Value Interpreter::evaluate(Get *expr)
 {
-    object::Object value = evaluate(stmt->expression);
-    io::writeLine(object::obj2str(value));
+    // Binding a method allocates while the instance is held nowhere else
+    stack.push_back(evaluate(expr->object));
+    object::Value result = property(expr, stack.back());
+    stack.pop_back();
+    return result;
 }
 
-void Interpreter::visit(Return *stmt)
+object::Value Interpreter::evaluate(Set *expr)
 {
-    object::Object value = object::Null{};
-    if (stmt->value) {
-        value = evaluate(stmt->value);
+    object::Value obj = evaluate(expr->object);
+    if (!obj.isInstance()) {
+        throw RuntimeError{expr->name, "Only instances have fields"};
     }
-    throw ReturnEx{value};
+    stack.push_back(obj);
+    object::Value value = evaluate(expr->value);
+    stack.push_back(value);
+    obj.asInstance()->setProperty(expr->name.symbol(), value, expr->cache);
+    stack.resize(stack.size() - 2);
+    return value;
 }
 
-void Interpreter::visit(While *stmt)
+void Interpreter::execute(While *stmt)
 {
     while (object::isTruthy(evaluate(stmt->condition))) {
         execute(stmt->body);
     }
 }
 
-void Interpreter::visit(Block *stmt)
+void Interpreter::execute(Block *stmt)
 {
-    EnvironmentPtr env = std::make_shared<Environment>(environment);
-    executeBlock(stmt->statements, env);
+    bool topLevel = !environment;
+    if (topLevel) {
+        environment = pushFrame();
+    }
+    std::size_t base = environment->size();
+    for (Stmt *statement : stmt->statements) {
+        execute(statement);
+    }
+    if (topLevel) {
+        popFrame();
+        environment = nullptr;
+    } else {
+        environment->truncate(base);
+    }
 }
 
-void Interpreter::visit(Class *stmt)
+object::Value Interpreter::property(Get *expr, const object::Value &obj)
 {
-    object::ClassPtr superclass;
-    if (stmt->superclass) {
-        auto super = evaluate(stmt->superclass);
-        if (!std::holds_alternative<object::CallablePtr>(super) and
-            std::dynamic_pointer_cast<object::Class>(std::get<object::CallablePtr>(super))) {  // Ugh!
-            Driver::error(stmt->superclass->name.line, "Superclass must be a class");
-        } else {
-            superclass = std::static_pointer_cast<object::Class>(std::get<object::CallablePtr>(super));
+    using Specialization = Get::Specialization;
+
+    if (!obj.isInstance()) {
+        throw RuntimeError{expr->name, "Only instances have properties"};
+    }
+    object::InstancePtr instance = obj.asInstance();
+    if (expr->specialization == Specialization::Field) {
+        if (instance->shapeId() == expr->shape) {
+            return instance->field(expr->offset);
         }
+        expr->specialization = Specialization::Generic;
+    } else if (expr->specialization == Specialization::Uninitialized) {
+        expr->specialization = Specialization::Generic;
+        if (auto offset = instance->findField(expr->name.symbol())) {
+            expr->specialization = Specialization::Field;
+            expr->shape = instance->shapeId();
+            expr->offset = *offset;
+            return instance->field(*offset);
+        }
+    }
+    return instance->getProperty(expr->name.symbol(), expr->cache);
+}
+
+object::Value Interpreter::super(Super *expr)
+{
+    auto superclassObj = lookUpVariable(expr->keyword, expr->location);
+    auto *superclass = static_cast<object::Class *>(superclassObj.asCallable());
+    object::InstancePtr instance = lookUpVariable(expr->keyword, expr->thisLocation).asInstance();
+    auto method = superclass->findMethod(expr->method.symbol());
+    if (!method) {
+        throw RuntimeError{expr->method, "Undefined property '" + expr->method.symbol()->chars + "'"};
     }
-    environment->define(stmt->name.lexeme, object::Null{});
+    return method->bind(instance);
+}
 
+void Interpreter::declare(FuncStmt *stmt)
+{
+    // Defined first, the function may capture its own name
+    define(stmt->name, object::Null{}, stmt->captured);
+    initialize(stmt->name, makeFunction(stmt, false));
+}
+
+void Interpreter::declare(Class *stmt)
+{
+    object::ClassPtr superclass = nullptr;
     if (stmt->superclass) {
-        environment = std::make_shared<Environment>(environment);
-        environment->define("super", superclass);
+        auto super = lookUpVariable(stmt->superclass->name, stmt->superclass->location);
+        if (super.isCallable() and super.asObj()->kind == object::Obj::Kind::Class) {
+            superclass = static_cast<object::Class *>(super.asCallable());
+        }
+        if (!superclass) {
+            throw RuntimeError{stmt->superclass->name, "Superclass must be a class"};
+        }
+    }
+    // Defined first, methods may capture the class name
+    define(stmt->name, object::Null{}, stmt->captured);
+    object::Roots roots;
+    // "super" is in a scope around the methods, which capture it
+    bool topLevel = !environment;
+    std::size_t base = 0;
+    if (superclass) {
+        roots.add(superclass);
+        if (topLevel) {
+            environment = pushFrame();
+        }
+        base = environment->size();
+        environment->define(superclass);
+        environment->box(static_cast<int>(base));
     }
 
-    std::map<std::string, object::FunctionPtr> methods;
+    object::SymbolMap<object::MethodPtr> methods;
     for (FuncStmt *method : stmt->methods) {
-        bool isInitializer = method->name.lexeme == "init";
-        auto func = std::make_shared<object::Function>(method, environment, isInitializer);
-        std::string methodName = method->name.lexeme;
-        auto p = std::make_pair<std::string, object::FunctionPtr>(std::move(methodName), std::move(func));
-        methods.emplace(std::move(p));
+        bool isInitializer = method->name.symbol() == object::symbols().init;
+        auto func = makeFunction(method, isInitializer);
+        roots.add(func);
+        methods.insert_or_assign(method->name.symbol(), func);
     }
-    auto classObject = std::make_shared<object::Class>(stmt->name.lexeme, superclass, methods);
+    auto classObject = object::make<object::Class>(stmt->name.symbol()->chars, superclass, std::move(methods));
 
     if (superclass) {
-        environment = environment->enclosing;
+        environment->truncate(base);
+        if (topLevel) {
+            popFrame();
+            environment = nullptr;
+        }
+    }
+    initialize(stmt->name, classObject);
+}
+
+bool Interpreter::enter(object::Function *callee, std::size_t base, const Token &token, bool invoked)
+{
+    if (frameCount >= maxDepth) {
+        throw RuntimeError{token, "Stack overflow"};
     }
-    environment->assign(stmt->name, classObject);
+    // Nothing refers to the scope of a call once it returns, closures have cells of their own
+    EnvironmentPtr env = pushFrame();
+    bind(env, callee, base, invoked);
+    // The node that made the call holds on to its task, the body only runs right away if the call
+    // and a statement of it that suspends fit in without moving the tasks. Otherwise run() gets to it
+    bool now = tasks.capacity() - tasks.size() >= 2;
+    tasks.push_back(Task{.kind = Task::Kind::Call, .environment = environment, .function = function, .base = base});
+    environment = env;
+    function = callee;
+    return now and proceed();
 }
 
-void Interpreter::visit(Var *stmt)
+bool Interpreter::proceed()
 {
-    object::Object value = object::Null{};
-    if (stmt->initializer) {
-        value = evaluate(stmt->initializer);
+    // Statements leave the calls in them to their tasks, short of the value of a return: a call
+    // there takes over this one, or is a class running its initializer, so this never nests deep
+    Task &task = tasks.back();
+    std::size_t count = tasks.size();
+    const std::vector<Stmt *> &body = function->code()->body;
+    while (task.step < body.size()) {
+        if (!begin(body[task.step++])) {
+            // The call is gone if the statement returned, a statement that suspended is above it
+            return tasks.size() < count;
+        }
+    }
+    // Running to the end returns nil
+    leave(object::Null{});
+    return true;
+}
+
+void Interpreter::reenter(object::Function *callee, std::size_t base, bool invoked)
+{
+    while (tasks.back().kind != Task::Kind::Call) {
+        tasks.pop_back();
+    }
+    Task &task = tasks.back();
+    // The callee and its arguments take the place of the running call's, its frame starts over
+    std::size_t count = stack.size() - base;
+    std::move(stack.begin() + static_cast<std::ptrdiff_t>(base), stack.end(),
+              stack.begin() + static_cast<std::ptrdiff_t>(task.base));
+    stack.resize(task.base + count);
+    environment->reset();
+    bind(environment, callee, task.base, invoked);
+    function = callee;
+    task.step = 0;
+    task.returning = false;
+}
+
+void Interpreter::bind(EnvironmentPtr frame, object::Function *callee, std::size_t base, bool invoked)
+{
+    if (callee->receiver) {
+        frame->define(callee->receiver);
+    } else if (invoked) {
+        frame->define(stack[base]);
+    }
+    for (std::size_t slot = base + 1; slot < stack.size(); ++slot) {
+        frame->define(stack[slot]);
+    }
+    for (int slot : callee->code()->cellSlots) {
+        frame->box(slot);
     }
-    environment->define(stmt->name.lexeme, value);
 }
 
-object::Object Interpreter::evaluate(Expr *expr)
+void Interpreter::leave(object::Value result)
 {
-    if (expr) {
-        return expr->accept(this);
+    // The statements and expressions in progress in the body are abandoned, the frame they used is
+    // dropped as a whole
+    while (tasks.back().kind != Task::Kind::Call) {
+        tasks.pop_back();
+    }
+    const Task &task = tasks.back();
+    if (function->isInitializer) {
+        result = function->receiver ? object::Value{function->receiver} : stack[task.base];
+    }
+    popFrame();
+    environment = task.environment;
+    function = task.function;
+    stack.resize(task.base + 1);
+    stack.back() = result;
+    tasks.pop_back();
+}
+
+object::Value Interpreter::binary(const Token &op, const object::Value &left, const object::Value &right)
+{
+    switch (op.kind) {
+    case Token::Kind::GreaterThanSign:
+        checkNumberOperands(op, left, right);
+        return left.asNumber() > right.asNumber();
+    case Token::Kind::GreaterEqual:
+        checkNumberOperands(op, left, right);
+        return left.asNumber() >= right.asNumber();
+    case Token::Kind::LessThanSign:
+        checkNumberOperands(op, left, right);
+        return left.asNumber() < right.asNumber();
+    case Token::Kind::LessEqual:
+        checkNumberOperands(op, left, right);
+        return left.asNumber() <= right.asNumber();
+    case Token::Kind::ExclaimEqual:
+        return !object::isEqual(left, right);
+    case Token::Kind::EqualEqual:
+        return object::isEqual(left, right);
+    case Token::Kind::HyphenMinus:
+        checkNumberOperands(op, left, right);
+        return left.asNumber() - right.asNumber();
+    case Token::Kind::PlusSign:
+        if (left.isNumber() and right.isNumber()) {
+            return left.asNumber() + right.asNumber();
+        }
+        if (left.isString() and right.isString()) {
+            return object::intern(left.asString()->chars + right.asString()->chars);
+        }
+        throw RuntimeError{op, "Operands must be two numbers or two strings"};
+    case Token::Kind::Solidus:
+        checkNumberOperands(op, left, right);
+        return left.asNumber() / right.asNumber();
+    case Token::Kind::Asterisk:
+        checkNumberOperands(op, left, right);
+        return left.asNumber() * right.asNumber();
+    default:
+        break;
     }
+
+    // Unreachable
     return object::Null{};
 }
 
-void Interpreter::execute(Stmt *stmt)
+Binary::Specialization Interpreter::specializeOnNumbers(Token::Kind op)
 {
-    if (stmt) {
-        stmt->accept(this);
+    using Specialization = Binary::Specialization;
+
+    switch (op) {
+    case Token::Kind::PlusSign:
+        return Specialization::NumberAdd;
+    case Token::Kind::HyphenMinus:
+        return Specialization::NumberSubtract;
+    case Token::Kind::Asterisk:
+        return Specialization::NumberMultiply;
+    case Token::Kind::Solidus:
+        return Specialization::NumberDivide;
+    case Token::Kind::GreaterThanSign:
+        return Specialization::NumberGreater;
+    case Token::Kind::GreaterEqual:
+        return Specialization::NumberGreaterEqual;
+    case Token::Kind::LessThanSign:
+        return Specialization::NumberLess;
+    case Token::Kind::LessEqual:
+        return Specialization::NumberLessEqual;
+    case Token::Kind::EqualEqual:
+        return Specialization::NumberEqual;
+    case Token::Kind::ExclaimEqual:
+        return Specialization::NumberNotEqual;
+    default:
+        return Specialization::Generic;
     }
 }
 
-void Interpreter::executeBlock(const std::vector<Stmt *> &stmts, EnvironmentPtr env)
+bool Interpreter::call(Call *expr, std::size_t base)
 {
-    EnvironmentPtr previous = this->environment;
+    object::Value callee = stack[base];
+    if (expr->specialization == Call::Specialization::Function and callee.isObj()
+        and callee.asObj()->kind == object::Obj::Kind::Function
+        and static_cast<object::Function *>(callee.asObj())->code() == expr->target) {
+        if (expr->tail) {
+            reenter(static_cast<object::Function *>(callee.asObj()), base);
+        } else {
+            return enter(static_cast<object::Function *>(callee.asObj()), base, expr->paren);
+        }
+        return false;
+    }
 
-    this->environment = env;
-    for (auto &stmt : stmts) {
-        execute(stmt);
+    std::size_t argCount = stack.size() - base - 1;
+    if (!callee.isCallable()) {
+        throw RuntimeError{expr->paren, "Can only call functions and classes"};
+    }
+    object::Callable *function = callee.asCallable();
+
+    if (function->kind == object::Obj::Kind::Class) {
+        auto *klass = static_cast<object::Class *>(function);
+        object::MethodPtr initializer = klass->initializer(expr->cache);
+        checkArity(expr->paren, initializer ? initializer->arity() : 0, argCount);
+        expr->specialization = Call::Specialization::Generic;
+        // The instance takes the place of the class, where the initializer finds it
+        klass->rootShape();
+        stack[base] = object::make<object::Instance>(klass);
+        if (initializer) {
+            // Methods of the tree-walker's classes are all Functions
+            return enter(static_cast<object::Function *>(initializer), base, expr->paren, true);
+        }
+        stack.resize(base + 1);
+        return true;
     }
-    this->environment = previous;
+
+    checkArity(expr->paren, function->arity(), argCount);
+    if (function->kind == object::Obj::Kind::Function) {
+        auto *callee = static_cast<object::Function *>(function);
+        if (expr->specialization == Call::Specialization::Uninitialized) {
+            expr->specialization = Call::Specialization::Function;
+            expr->target = callee->code();
+        } else {
+            expr->specialization = Call::Specialization::Generic;
+        }
+        if (expr->tail) {
+            reenter(callee, base);
+        } else {
+            return enter(callee, base, expr->paren);
+        }
+        return false;
+    }
+    expr->specialization = Call::Specialization::Generic;
+    object::Value result = function->call(this, object::Arguments{stack.data() + base + 1, argCount});
+    stack.resize(base + 1);
+    stack.back() = result;
+    return true;
 }
 
-void Interpreter::resolve(Expr *expr, int depth)
+bool Interpreter::invoke(Call *expr, std::size_t base)
 {
-    locals[expr] = depth;
+    auto *get = static_cast<Get *>(expr->callee);
+    object::Value receiver = stack[base];
+    if (receiver.isInstance()) {
+        if (object::MethodPtr method = receiver.asInstance()->getMethod(get->name.symbol(), get->cache)) {
+            auto *callee = static_cast<object::Function *>(method);
+            checkArity(expr->paren, callee->arity(), stack.size() - base - 1);
+            if (expr->tail) {
+                reenter(callee, base, true);
+            } else {
+                return enter(callee, base, expr->paren, true);
+            }
+            return false;
+        }
+    }
+    // A field is called like any other value
+    stack[base] = property(get, receiver);
+    return call(expr, base);
 }
 
-object::Object Interpreter::lookUpVariable(Token name, Expr *expr)
+object::Value Interpreter::lookUpVariable(const Name &name, const Location &location)
 {
-    if (auto it = locals.find(expr); it != locals.end()) {
-        int distance = locals.at(expr);
-        return environment->getAt(distance, name.lexeme);
-    } else {
-        return globals->get(name);
+    switch (location.kind) {
+    case Location::Kind::Local:
+        return environment->get(location.slot);
+    case Location::Kind::Cell:
+        return *environment->cellAt(location.slot)->location;
+    case Location::Kind::Upvalue:
+        return *function->upvalues[location.slot]->location;
+    case Location::Kind::Global:
+        break;
+    }
+    auto it = globals.find(name.symbol());
+    if (it == globals.end()) {
+        throw RuntimeError{name, "Undefined variable '" + name.symbol()->chars + "'"};
+    }
+    return it->second;
+}
+
+void Interpreter::assignVariable(const Name &name, const Location &location, const object::Value &value)
+{
+    switch (location.kind) {
+    case Location::Kind::Local:
+        environment->assign(location.slot, value);
+        return;
+    case Location::Kind::Cell:
+        *environment->cellAt(location.slot)->location = value;
+        return;
+    case Location::Kind::Upvalue:
+        *function->upvalues[location.slot]->location = value;
+        return;
+    case Location::Kind::Global:
+        break;
+    }
+    auto it = globals.find(name.symbol());
+    if (it == globals.end()) {
+        throw RuntimeError{name, "Undefined variable '" + name.symbol()->chars + "'"};
+    }
+    it->second = value;
+}
+
+void Interpreter::define(const Name &name, const object::Value &value, bool captured)
+{
+    if (!environment) {
+        globals.insert_or_assign(name.symbol(), value);
+        return;
+    }
+    environment->define(value);
+    if (captured) {
+        environment->box(static_cast<int>(environment->size()) - 1);
+    }
+}
+
+void Interpreter::initialize(const Name &name, const object::Value &value)
+{
+    if (!environment) {
+        globals.insert_or_assign(name.symbol(), value);
+        return;
+    }
+    environment->initialize(value);
+}
+
+object::FunctionPtr Interpreter::makeFunction(FuncStmt *declaration, bool isInitializer)
+{
+    std::vector<object::UpvaluePtr> upvalues;
+    upvalues.reserve(declaration->captures.size());
+    for (const Capture &capture : declaration->captures) {
+        if (capture.isLocal) {
+            upvalues.push_back(environment->cellAt(capture.slot));
+        } else {
+            upvalues.push_back(function->upvalues[capture.slot]);
+        }
+    }
+    return object::make<object::Function>(declaration, std::move(upvalues), isInitializer);
+}
+
+void Interpreter::resetStack()
+{
+    tasks.clear();
+    stack.clear();
+    environment = nullptr;
+    function = nullptr;
+    while (frameCount > 0) {
+        popFrame();
+    }
+}
+
+EnvironmentPtr Interpreter::pushFrame()
+{
+    if (frameCount == frames.size()) {
+        frames.push_back(object::make<Environment>());
+    }
+    return frames[frameCount++];
+}
+
+void Interpreter::popFrame()
+{
+    // Drops what the scope refers to, nothing else can see it anymore
+    frames[--frameCount]->reset();
+}
+
+void Interpreter::checkArity(const Token &paren, std::size_t arity, std::size_t argCount)
+{
+    if (argCount == arity) {
+        return;
     }
+    throw RuntimeError{paren, "Expected " + std::to_string(arity) + " arguments but got " + std::to_string(argCount)};
 }
 
-void Interpreter::checkNumberOperand(const Token &op, const object::Object &operand)
+void Interpreter::checkNumberOperand(const Token &op, const object::Value &operand)
 {
-    if (std::holds_alternative<object::Number>(operand)) {
+    if (operand.isNumber()) {
         return;
     }
     throw RuntimeError{op, "Operand must be a number"};
 }
 
-void Interpreter::checkNumberOperands(const Token &op, const object::Object &left, const object::Object &right)
+void Interpreter::checkNumberOperands(const Token &op, const object::Value &left, const object::Value &right)
 {
-    if (std::holds_alternative<object::Number>(left) and std::holds_alternative<object::Number>(right)) {
+    if (left.isNumber() and right.isNumber()) {
         return;
     }
     throw RuntimeError{op, "Operands must be numbers"};
@@ -2,56 +2,145 @@
 
 #include "ast.h"
 #include "environment.h"
+#include "heap.h"
 #include "obj_function.h"
 
 #include <vector>
 
 namespace draft {
 
-class Interpreter : public IExprVisitor<object::Object>, IStmtVisitor<void> {
+// Tree-walking evaluator. Calls run on stacks of its own on the heap rather than on the native one:
+// a node that may run a call is a task, which schedules its children and resumes once they have
+// left their values on the value stack. A script call takes no native frame, so how deep calls
+// nest is only bounded by maxDepth. Subtrees without calls are evaluated right away by recursion,
+// which goes no deeper than the source
+class Interpreter : object::RootSet {
 public:
+    static constexpr std::size_t DefaultMaxDepth = 100'000;
+
     Interpreter();
+    ~Interpreter() override;
     void interpret(const std::vector<Stmt *> &statements);
+    // Runs a function to completion, for callers outside of the evaluator
+    object::Value call(object::Function *callee, object::Arguments arguments);
+
+    void markRoots(object::Heap &heap) override;
 
-    object::Object visit(Literal *expr) override;
-    object::Object visit(Logical *expr) override;
-    object::Object visit(Unary *expr) override;
-    object::Object visit(Binary *expr) override;
-    object::Object visit(Call *expr) override;
-    object::Object visit(Grouping *expr) override;
-    object::Object visit(Variable *expr) override;
-    object::Object visit(Assign *expr) override;
-    object::Object visit(Get *expr) override;
-    object::Object visit(Set *expr) override;
-    object::Object visit(Super *expr) override;
-    object::Object visit(This *expr) override;
-
-    void visit(ExprStmt *stmt) override;
-    void visit(If *stmt) override;
-    void visit(FuncStmt *stmt) override;
-    void visit(Print *stmt) override;
-    void visit(Return *stmt) override;
-    void visit(While *stmt) override;
-    void visit(Block *stmt) override;
-    void visit(Class *stmt) override;
-    void visit(Var *stmt) override;
-
-    void resolve(Expr *expr, int depth);
+    // Calls nested deeper than this are reported as a stack overflow
+    std::size_t maxDepth = DefaultMaxDepth;
 
 private:
-    object::Object evaluate(Expr *expr);
+    // A node waiting for its children, or a call running the statements of its body
+    struct Task {
+        enum class Kind : std::uint8_t { Expr, Stmt, Call };
+
+        Kind kind = Kind::Expr;
+        bool ownsFrame = false;  // a top-level block, which took a frame for its variables
+        bool returning = false;  // a call whose body is working out the value it returns
+        std::uint32_t step = 0;  // how far the node or the body of the call has got
+        memory::Object *node = nullptr;
+        // What a call restores when it returns, and for calls and blocks where their values and
+        // variables start
+        EnvironmentPtr environment = nullptr;
+        object::FunctionPtr function = nullptr;
+        std::size_t base = 0;
+    };
+
+    // Runs tasks until only the first floor of them are left
+    void run(std::size_t floor);
+
+    // Starts on a node. One that cannot suspend is done with right away, which returns true, the
+    // others become tasks. Expressions leave their value on the stack
+    bool begin(Expr *expr);
+    bool begin(Stmt *stmt);
+
+    // Take the next step of a node, the task is dropped once the node is done
+    void advance(Logical *expr, Task &task);
+    void advance(Unary *expr, Task &task);
+    void advance(Binary *expr, Task &task);
+    void advance(Call *expr, Task &task);
+    void advance(Assign *expr, Task &task);
+    void advance(Get *expr, Task &task);
+    void advance(Set *expr, Task &task);
+
+    void advance(ExprStmt *stmt, Task &task);
+    void advance(If *stmt, Task &task);
+    void advance(Print *stmt, Task &task);
+    void advance(Return *stmt, Task &task);
+    void advance(While *stmt, Task &task);
+    void advance(Block *stmt, Task &task);
+    void advance(Var *stmt, Task &task);
+
+    // Nodes that cannot suspend
+    object::Value evaluate(Expr *expr);
+    object::Value evaluate(Logical *expr);
+    object::Value evaluate(Unary *expr);
+    object::Value evaluate(Binary *expr);
+    object::Value evaluate(Assign *expr);
+    object::Value evaluate(Get *expr);
+    object::Value evaluate(Set *expr);
     void execute(Stmt *stmt);
-    void executeBlock(const std::vector<Stmt *> &stmts, EnvironmentPtr env);
-    object::Object lookUpVariable(Token name, Expr *expr);
+    void execute(While *stmt);
+    void execute(Block *stmt);
+
+    object::Value unary(Unary *expr, const object::Value &right);
+    object::Value binary(Binary *expr, const object::Value &left, const object::Value &right);
+    object::Value property(Get *expr, const object::Value &obj);
+    object::Value super(Super *expr);
+    void declare(FuncStmt *stmt);
+    void declare(Class *stmt);
+
+    // Starts running callee, whose arguments follow it on the stack at base. A method invoked on a
+    // receiver, or an initializer run by its class, finds the receiver at base instead of bound.
+    // True if the body returned without suspending, its result is at base then
+    bool enter(object::Function *callee, std::size_t base, const Token &token, bool invoked = false);
+    // Runs the body of the running call until a statement suspends, true if it returned
+    bool proceed();
+    // Runs callee in place of the running call, for a call in tail position. The call returns
+    // whatever callee does, without a frame of its own
+    void reenter(object::Function *callee, std::size_t base, bool invoked = false);
+    // Defines the receiver and arguments of callee in frame
+    void bind(EnvironmentPtr frame, object::Function *callee, std::size_t base, bool invoked);
+    // Returns from the running call, leaving result in place of its callee and arguments. The tasks
+    // of its body still in progress are dropped
+    void leave(object::Value result);
+
+    object::Value lookUpVariable(const Name &name, const Location &location);
+    void assignVariable(const Name &name, const Location &location, const object::Value &value);
+    void define(const Name &name, const object::Value &value, bool captured);
+    // Stores the value of the variable defined last in the current scope
+    void initialize(const Name &name, const object::Value &value);
+    object::FunctionPtr makeFunction(FuncStmt *declaration, bool isInitializer);
+
+    // Generic paths of the nodes that specialize themselves, see ast.h
+    object::Value binary(const Token &op, const object::Value &left, const object::Value &right);
+    static Binary::Specialization specializeOnNumbers(Token::Kind op);
+    // Calls the callee at base, true if its result is already there rather than left by a task
+    bool call(Call *expr, std::size_t base);
+    // Like call(), for a method called on the receiver at base without binding it
+    bool invoke(Call *expr, std::size_t base);
+
+    void resetStack();
+    // Scope for a call, reused once the call is done
+    EnvironmentPtr pushFrame();
+    void popFrame();
 
-    void checkNumberOperand(const Token &op, const object::Object &operand);
-    void checkNumberOperands(const Token &op, const object::Object &left, const object::Object &right);
+    void checkArity(const Token &paren, std::size_t arity, std::size_t argCount);
+    void checkNumberOperand(const Token &op, const object::Value &operand);
+    void checkNumberOperands(const Token &op, const object::Value &left, const object::Value &right);
 
-    std::map<Expr *, int> locals;
-    EnvironmentPtr globals;
-    EnvironmentPtr environment;
+    object::SymbolMap<object::Value> globals;
+    // Frame of the running call or top-level block, null at the top level
+    EnvironmentPtr environment = nullptr;
+    // Function being run, its upvalues hold the variables it captured. Null at the top level
+    object::FunctionPtr function = nullptr;
 
-    friend class object::Function;
+    std::vector<Task> tasks;
+    // Values of the expressions in progress, and the callees and arguments of the calls
+    std::vector<object::Value> stack;
+    // Scopes of the calls in progress that took one from the pool come first
+    std::vector<EnvironmentPtr> frames;
+    std::size_t frameCount = 0;
 };
 
 }  // namespace draft
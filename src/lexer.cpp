@@ -1,3 +1,5 @@
+#include <array>
+#include <cstdint>
 #include <iomanip>
 #include <iostream>
 
@@ -5,23 +7,100 @@
 #include "lexer.h"
 
 namespace draft {
+namespace {
+
+// Keywords are told apart from other identifiers by a perfect hash: the table below has a slot of
+// its own for each keyword in token.def, found at compile time. Looking a name up takes one hash
+// and one comparison with whatever keyword is in its slot
+struct Keyword {
+    std::string_view name;
+    Token::Kind kind = Token::Kind::Identifier;
+};
+
+constexpr Keyword keywords[] = {
+#define KEYWORD(kind, name) Keyword{name, Token::Kind::kind},
+#include "token.def"
+};
+
+constexpr std::size_t KeywordBits = 5;
+constexpr std::uint32_t NoSeed = ~std::uint32_t{0};
+
+// The first and last characters and the length tell the keywords apart. Packed together they are
+// scattered over the slots by a multiplicative hash, which is a single multiplication once the seed
+// is known
+constexpr std::size_t keywordSlot(std::string_view name, std::uint32_t seed)
+{
+    std::uint32_t key = static_cast<unsigned char>(name.front()) | static_cast<unsigned char>(name.back()) << 8 |
+                        static_cast<std::uint32_t>(name.size()) << 16;
+    return (key * (seed * 0x9e3779b1)) >> (32 - KeywordBits);
+}
+
+// The first seed that puts no two keywords in the same slot
+constexpr std::uint32_t findKeywordSeed()
+{
+    for (std::uint32_t seed = 0; seed < 10'000; ++seed) {
+        std::array<bool, 1 << KeywordBits> taken{};
+        bool collides = false;
+        for (const Keyword &keyword : keywords) {
+            std::size_t slot = keywordSlot(keyword.name, seed);
+            collides = collides or taken[slot];
+            taken[slot] = true;
+        }
+        if (!collides) {
+            return seed;
+        }
+    }
+    return NoSeed;
+}
+
+constexpr std::uint32_t keywordSeed = findKeywordSeed();
+static_assert(keywordSeed != NoSeed, "No seed hashes the keywords to slots of their own, add to KeywordBits");
+
+constexpr auto keywordTable = [] {
+    std::array<Keyword, 1 << KeywordBits> table{};
+    for (const Keyword &keyword : keywords) {
+        table[keywordSlot(keyword.name, keywordSeed)] = keyword;
+    }
+    return table;
+}();
+
+// Empty slots have an empty name, which no identifier matches. Keywords are short enough that
+// comparing a character at a time beats calling memcmp
+Token::Kind keywordOrIdentifier(std::string_view name)
+{
+    const Keyword &keyword = keywordTable[keywordSlot(name, keywordSeed)];
+    if (keyword.name.size() != name.size()) {
+        return Token::Kind::Identifier;
+    }
+    for (std::size_t i = 0; i < name.size(); ++i) {
+        if (keyword.name[i] != name[i]) {
+            return Token::Kind::Identifier;
+        }
+    }
+    return keyword.kind;
+}
+
+}  // namespace
 
 Lexer::Lexer(std::string_view source)
     : source{source}
+    , scanner{scan::scanner()}
 {
 }
 
 std::vector<Token> Lexer::scanTokens()
 {
+    // Tokens take three bytes of source or more on average, counting the blanks between them.
+    // Growing the vector as it fills took about a third of the time on large scripts
+    tokens.reserve(source.size() / 3);
     while (!isAtEnd()) {
         // We are at the beginning of the next lexeme
         start = current;
         scanToken();
     }
 
-    Token eof{Token::Kind::EndOfFile, "", object::Null{}, line};
-    tokens.emplace_back(std::move(eof));
-    return tokens;
+    tokens.emplace_back(Token::Kind::EndOfFile, source.substr(source.size()), line);
+    return std::move(tokens);
 }
 
 bool Lexer::isAtEnd()
@@ -78,9 +157,7 @@ void Lexer::scanToken()
     case '/':
         if (match('/')) {
             // A comment goes until the end of the line
-            while (peek() != '\n' and !isAtEnd()) {
-                advance();
-            }
+            current = scanner.lineEnd(source, current);
         } else {
             addToken(Token::Kind::Solidus);
         }
@@ -90,10 +167,13 @@ void Lexer::scanToken()
     case '\r':
         [[fallthrough]];
     case '\t':
-        // Ignore whitespace
-        break;
+        [[fallthrough]];
     case '\n':
-        line++;
+        // Ignore whitespace. Most runs are a single space between tokens, which is not worth a call
+        if (c == ' ' and !isBlank(peek())) {
+            break;
+        }
+        current = scanner.blank(source, start, line);
         break;
 
     case '"':
@@ -116,9 +196,10 @@ void Lexer::scanToken()
     }
 }
 
+// The scanning loops check for the end of the source themselves, the accessors below need not
 char Lexer::advance()
 {
-    return source.at(current++);
+    return source[current++];
 }
 
 bool Lexer::match(char expected)
@@ -126,7 +207,7 @@ bool Lexer::match(char expected)
     if (isAtEnd()) {
         return false;
     }
-    if (source.at(current) != expected) {
+    if (source[current] != expected) {
         return false;
     }
     current++;
@@ -138,7 +219,7 @@ char Lexer::peek()
     if (isAtEnd()) {
         return '\0';
     }
-    return source.at(current);
+    return source[current];
 }
 
 char Lexer::peekNext()
@@ -146,18 +227,12 @@ char Lexer::peekNext()
     if (current + 1 >= source.length()) {
         return '\0';
     }
-    return source.at(current + 1);
+    return source[current + 1];
 }
 
 void Lexer::string(char quote)
 {
-    while (peek() != quote and not isAtEnd()) {
-        if (peek() == '\n') {
-            line++;
-        }
-        advance();
-    }
-
+    current = scanner.stringEnd(source, current, quote, line);
     if (isAtEnd()) {
         scanError("Unterminated string");
         return;
@@ -165,12 +240,7 @@ void Lexer::string(char quote)
 
     // The closing quote
     advance();
-
-    std::string_view value = substr();
-    // Trim the surrounding quotes
-    value.remove_prefix(1);
-    value.remove_suffix(1);
-    addToken(Token::Kind::StringLiteral, object::String{value});
+    addToken(Token::Kind::StringLiteral);
 }
 
 void Lexer::number()
@@ -189,37 +259,23 @@ void Lexer::number()
         }
     }
 
-    double value = std::stod(std::string{substr()});
-    addToken(Token::Kind::NumberLiteral, object::Number{value});
+    addToken(Token::Kind::NumberLiteral);
 }
 
 void Lexer::identifier()
 {
-    while (isAlphaNumeric(peek())) {
-        advance();
-    }
-
-    auto maybeKeyword = [](std::string_view sv) {
-#define KEYWORD(kind, name)       \
-    if (name == sv) {             \
-        return Token::Kind::kind; \
-    }
-#include "token.def"
-        return Token::Kind::Identifier;
-    };
-
-    addToken(maybeKeyword(substr()));
+    current = scanner.identifierEnd(source, current);
+    addToken(keywordOrIdentifier(substr()));
 }
 
 void Lexer::addToken(Token::Kind kind)
 {
-    addToken(kind, object::Null{});
+    tokens.emplace_back(kind, substr(), line);
 }
 
-void Lexer::addToken(Token::Kind kind, object::Object literal)
+bool Lexer::isBlank(char c)
 {
-    Token t{kind, std::string{substr()}, literal, line};
-    tokens.emplace_back(std::move(t));
+    return c == ' ' or c == '\r' or c == '\t' or c == '\n';
 }
 
 bool Lexer::isDigit(char c)
@@ -232,11 +288,6 @@ bool Lexer::isAlpha(char c)
     return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or c == '_';
 }
 
-bool Lexer::isAlphaNumeric(char c)
-{
-    return isAlpha(c) or isDigit(c);
-}
-
 std::string_view Lexer::substr()
 {
     std::size_t pos = start;
@@ -3,6 +3,7 @@
 #include <string_view>
 #include <vector>
 
+#include "scan.h"
 #include "token.h"
 
 namespace draft {
@@ -27,17 +28,17 @@ private:
     void identifier();
 
     void addToken(Token::Kind kind);
-    void addToken(Token::Kind kind, object::Object literal);
 
+    bool isBlank(char c);
     bool isDigit(char c);
     bool isAlpha(char c);
-    bool isAlphaNumeric(char c);
 
     std::string_view substr();
 
     void scanError(const std::string &message);
 
     std::string_view source;
+    const scan::Scanner &scanner;
     std::vector<Token> tokens;
 
     std::size_t start = 0;
@@ -1,10 +1,64 @@
+#include <charconv>
 #include <vector>
 
 #include "driver.h"
+#include "heap.h"
+#include "scan.h"
 
-int processCommandLine(const std::vector<std::string> &args)
+int processCommandLine(std::vector<std::string> args)
 {
     using namespace draft;
+    constexpr std::string_view engineOption = "--engine=";
+    constexpr std::string_view growthOption = "--gc-growth=";
+    constexpr std::string_view depthOption = "--max-depth=";
+    constexpr std::string_view scannerOption = "--scanner=";
+    object::Heap::Options heapOptions;
+    while (!args.empty() and args.front().starts_with("--")) {
+        std::string_view option = args.front();
+        if (option.starts_with(engineOption)) {
+            std::string_view engine = option.substr(engineOption.size());
+            if (engine == "stack") {
+                Driver::engine = Driver::Engine::Stack;
+            } else if (engine == "register") {
+                Driver::engine = Driver::Engine::Register;
+            } else if (engine == "tree") {
+                Driver::engine = Driver::Engine::Tree;
+            } else {
+                return Driver::usage();
+            }
+        } else if (option.starts_with(growthOption)) {
+            std::string_view factor = option.substr(growthOption.size());
+            auto [end, ec] = std::from_chars(factor.data(), factor.data() + factor.size(), heapOptions.growthFactor);
+            if (ec != std::errc{} or end != factor.data() + factor.size() or heapOptions.growthFactor < 1.0) {
+                return Driver::usage();
+            }
+        } else if (option.starts_with(depthOption)) {
+            std::string_view depth = option.substr(depthOption.size());
+            auto [end, ec] = std::from_chars(depth.data(), depth.data() + depth.size(), Driver::maxDepth);
+            if (ec != std::errc{} or end != depth.data() + depth.size() or Driver::maxDepth == 0) {
+                return Driver::usage();
+            }
+        } else if (option.starts_with(scannerOption)) {
+            if (!scan::choose(option.substr(scannerOption.size()))) {
+                return Driver::usage();
+            }
+        } else if (option == "--gc-stress") {
+            heapOptions.stress = true;
+        } else if (option == "--gc-stats") {
+            Driver::heapStats = true;
+        } else if (option == "--cache-stats") {
+            Driver::cacheStats = true;
+        } else if (option == "--dispatch-stats") {
+            Driver::dispatchStats = true;
+        } else if (option == "--scan-stats") {
+            Driver::scanStats = true;
+        } else {
+            return Driver::usage();
+        }
+        args.erase(args.begin());
+    }
+    object::heap().configure(heapOptions);
+
     if (args.size() > 1) {
         return Driver::usage();
     } else if (args.size() == 1) {
@@ -1,15 +1,35 @@
 #pragma once
 
+#include <span>
+
 #include "object.h"
 
 namespace draft::object {
 
-class Callable {
+// Arguments of a call, a view into the caller's value stack
+using Arguments = std::span<const Value>;
+
+class Callable : public Obj {
 public:
-    virtual ~Callable() = default;
+    using Obj::Obj;
 
     virtual std::size_t arity() = 0;
-    virtual Object call(Interpreter *interpreter, std::vector<Object> arguments) = 0;
+    virtual Value call(Interpreter *interpreter, Arguments arguments) = 0;
+};
+
+// A callable that lives in a class and can be bound to an instance of it
+class Method : public Callable {
+public:
+    using Callable::Callable;
+
+    virtual CallablePtr bind(InstancePtr instance) = 0;
 };
 
+using MethodPtr = Method *;
+
+inline Callable *Value::asCallable() const
+{
+    return static_cast<Callable *>(asObj());
+}
+
 }  // namespace draft::object
@@ -1,38 +1,79 @@
 #include "obj_class.h"
 
+#include "heap.h"
 #include "obj_instance.h"
 
 namespace draft::object {
-Class::Class(std::string name, ClassPtr superclass, std::map<std::string, object::FunctionPtr> methods)
-    : name{name}
-    , methods{methods}
+Class::Class(std::string name, ClassPtr superclass, SymbolMap<MethodPtr> methods)
+    : Callable{Kind::Class}
+    , name{std::move(name)}
+    , methods{std::move(methods)}
     , superclass{superclass}
 {
 }
 
+void Class::trace(Heap &heap)
+{
+    for (const auto &[name, method] : methods) {
+        heap.mark(name);
+        heap.mark(method);
+    }
+    heap.mark(superclass);
+    heap.mark(shape);
+}
+
 std::size_t Class::arity()
 {
-    auto initializer = findMethod("init");
+    auto initializer = findMethod(symbols().init);
     if (initializer) {
         return initializer->arity();
     }
     return 0;
 }
 
-Object Class::call(Interpreter *interpreter, std::vector<Object> arguments)
+Value Class::call(Interpreter *interpreter, Arguments arguments)
 {
-    auto instance = std::make_shared<Instance>(*this);
-    auto initializer = findMethod("init");
+    return instantiate(interpreter, arguments, findMethod(symbols().init));
+}
+
+Value Class::instantiate(Interpreter *interpreter, Arguments arguments, MethodPtr initializer)
+{
+    rootShape();
+    auto instance = make<Instance>(this);
     if (initializer) {
-        initializer->bind(instance)->call(interpreter, arguments);
+        Roots roots;
+        roots.add(instance);
+        CallablePtr bound = initializer->bind(instance);
+        roots.add(bound);
+        bound->call(interpreter, arguments);
     }
     return instance;
 }
 
-FunctionPtr Class::findMethod(std::string name)
+ShapePtr Class::rootShape()
+{
+    if (!shape) {
+        shape = make<Shape>();
+    }
+    return shape;
+}
+
+MethodPtr Class::initializer(InlineCache &cache)
+{
+    // Every class has a root shape of its own, so it identifies the class
+    ShapePtr root = rootShape();
+    if (const auto *entry = cache.find(root)) {
+        return entry->method;
+    }
+    MethodPtr method = findMethod(symbols().init);
+    cache.add(root, {.method = method});
+    return method;
+}
+
+MethodPtr Class::findMethod(String *name)
 {
-    if (methods.contains(name)) {
-        return methods.at(name);
+    if (auto it = methods.find(name); it != methods.end()) {
+        return it->second;
     }
     if (superclass) {
         return superclass->findMethod(name);
@@ -1,27 +1,36 @@
 #pragma once
 
-#include <map>
-
+#include "inline_cache.h"
 #include "obj_callable.h"
 #include "obj_function.h"
+#include "obj_shape.h"
 
 namespace draft::object {
 class Class;
-using ClassPtr = std::shared_ptr<Class>;
+using ClassPtr = Class *;
 
 class Class : public Callable {
 public:
-    Class(std::string name, ClassPtr superclass, std::map<std::string, object::FunctionPtr> methods);
+    Class(std::string name, ClassPtr superclass, SymbolMap<MethodPtr> methods);
+
+    void trace(Heap &heap) override;
 
     std::size_t arity() override;
-    object::Object call(Interpreter *interpreter, std::vector<Object> arguments) override;
+    object::Value call(Interpreter *interpreter, Arguments arguments) override;
+    // Like call(), with the initializer already looked up
+    Value instantiate(Interpreter *interpreter, Arguments arguments, MethodPtr initializer);
 
-    object::FunctionPtr findMethod(std::string name);
+    MethodPtr findMethod(String *name);
+    // The initializer, null if there is none, looked up through the cache of the calling site
+    MethodPtr initializer(InlineCache &cache);
+    // Shape of a fresh instance, created on first use
+    ShapePtr rootShape();
 
     std::string name;
 
-    std::map<std::string, object::FunctionPtr> methods;
-    ClassPtr superclass;
+    SymbolMap<MethodPtr> methods;
+    ClassPtr superclass = nullptr;
+    ShapePtr shape = nullptr;
 };
 
 }  // namespace draft::object
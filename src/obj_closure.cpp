@@ -0,0 +1,105 @@
+#include "obj_closure.h"
+
+#include <stdexcept>
+
+#include "heap.h"
+#include "obj_instance.h"
+
+namespace draft::object {
+
+Prototype::Prototype(std::string name)
+    : Obj{Kind::Prototype}
+    , name{std::move(name)}
+{
+}
+
+void Prototype::trace(Heap &heap)
+{
+    for (const Value &constant : chunk.constants) {
+        heap.mark(constant);
+    }
+    for (Prototype *prototype : chunk.prototypes) {
+        heap.mark(prototype);
+    }
+}
+
+Upvalue::Upvalue(Value *slot)
+    : Obj{Kind::Upvalue}
+    , location{slot}
+{
+}
+
+Upvalue::Upvalue(const Value &value)
+    : Obj{Kind::Upvalue}
+    , location{&closed}
+    , closed{value}
+{
+}
+
+// An open upvalue's variable lives on the VM stack, which is a root of its own
+void Upvalue::trace(Heap &heap)
+{
+    heap.mark(closed);
+}
+
+void Upvalue::close()
+{
+    closed = *location;
+    location = &closed;
+}
+
+Closure::Closure(PrototypePtr prototype)
+    : Method{Kind::Closure}
+    , prototype{prototype}
+{
+    upvalues.resize(prototype->upvalueCount);
+}
+
+void Closure::trace(Heap &heap)
+{
+    heap.mark(prototype);
+    for (Upvalue *upvalue : upvalues) {
+        heap.mark(upvalue);
+    }
+}
+
+std::size_t Closure::arity()
+{
+    return prototype->arity;
+}
+
+Value Closure::call(Interpreter *, Arguments)
+{
+    // Bytecode frames are pushed by the VM itself, it never calls closures through this interface
+    throw std::logic_error{"Compiled function '" + prototype->name + "' can only be called by the VM"};
+}
+
+CallablePtr Closure::bind(InstancePtr instance)
+{
+    return make<BoundMethod>(instance, this);
+}
+
+BoundMethod::BoundMethod(InstancePtr receiver, ClosurePtr method)
+    : Callable{Kind::BoundMethod}
+    , receiver{receiver}
+    , method{method}
+{
+}
+
+void BoundMethod::trace(Heap &heap)
+{
+    heap.mark(receiver);
+    heap.mark(method);
+}
+
+std::size_t BoundMethod::arity()
+{
+    return method->arity();
+}
+
+Value BoundMethod::call(Interpreter *, Arguments)
+{
+    throw std::logic_error{"Compiled method '" + method->prototype->name + "' can only be called by the VM"};
+}
+
+}  // namespace draft::object
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "chunk.h"
+#include "obj_callable.h"
+
+namespace draft::object {
+
+// A function compiled to bytecode. Closures are made from it at runtime
+class Prototype : public Obj {
+public:
+    explicit Prototype(std::string name);
+
+    void trace(Heap &heap) override;
+
+    std::string name;
+    std::size_t arity = 0;
+    std::size_t upvalueCount = 0;
+    // Registers a frame of register machine code needs
+    std::size_t registerCount = 0;
+    // Stack slots a frame of stack machine code needs, from the callee up
+    std::size_t stackSize = 0;
+    Chunk chunk;
+};
+
+// A variable captured by a closure. While the variable is alive on the VM stack the upvalue
+// points to its slot; when the slot goes away the value is moved into the upvalue itself. The
+// tree-walker keeps captured variables in closed upvalues from the start
+class Upvalue : public Obj {
+public:
+    explicit Upvalue(Value *slot);
+    explicit Upvalue(const Value &value);
+
+    void trace(Heap &heap) override;
+
+    void close();
+
+    Value *location = nullptr;
+    Value closed;
+    Upvalue *next = nullptr;  // open upvalues are chained from the top of the stack down
+};
+
+using UpvaluePtr = Upvalue *;
+
+class Closure : public Method {
+public:
+    explicit Closure(PrototypePtr prototype);
+
+    void trace(Heap &heap) override;
+
+    std::size_t arity() override;
+    Value call(Interpreter *interpreter, Arguments arguments) override;
+    CallablePtr bind(InstancePtr instance) override;
+
+    PrototypePtr prototype;
+    std::vector<UpvaluePtr> upvalues;
+};
+
+using ClosurePtr = Closure *;
+
+// A method closure paired with the instance it was accessed from
+class BoundMethod : public Callable {
+public:
+    BoundMethod(InstancePtr receiver, ClosurePtr method);
+
+    void trace(Heap &heap) override;
+
+    std::size_t arity() override;
+    Value call(Interpreter *interpreter, Arguments arguments) override;
+
+    InstancePtr receiver;
+    ClosurePtr method;
+};
+
+}  // namespace draft::object
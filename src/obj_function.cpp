@@ -1,20 +1,25 @@
 #include "obj_function.h"
 
+#include "heap.h"
 #include "interpreter.h"
+#include "obj_instance.h"
 
 namespace draft {
-ReturnEx::ReturnEx(object::Object value)
-    : std::runtime_error{""}
-    , value{std::move(value)}
+namespace object {
+Function::Function(FuncStmt *declaration, std::vector<UpvaluePtr> upvalues, bool isInitializer)
+    : Method{Kind::Function}
+    , upvalues{std::move(upvalues)}
+    , declaration{declaration}
+    , isInitializer{isInitializer}
 {
 }
 
-namespace object {
-Function::Function(FuncStmt *declaration, EnvironmentPtr closure, bool isInitializer)
-    : declaration{declaration}
-    , closure{closure}
-    , isInitializer{isInitializer}
+void Function::trace(Heap &heap)
 {
+    for (Upvalue *upvalue : upvalues) {
+        heap.mark(upvalue);
+    }
+    heap.mark(receiver);
 }
 
 std::size_t Function::arity()
@@ -25,36 +30,21 @@ std::size_t Function::arity()
     return 0;
 }
 
-object::Object Function::call(Interpreter *interpreter, std::vector<object::Object> arguments)
+object::Value Function::call(Interpreter *interpreter, Arguments arguments)
 {
     if (!declaration) {
         return Null{};
     }
-    EnvironmentPtr env = std::make_shared<Environment>(closure);
-    auto params = declaration->params;
-    for (std::size_t i = 0; i < params.size(); ++i) {
-        env->define(params.at(i).lexeme, arguments.at(i));
-    }
-    try {
-        interpreter->executeBlock(declaration->body, env);
-    } catch (const ReturnEx &returnValue) {
-        if (isInitializer) {
-            return closure->getAt(0, "this");
-        }
-        return returnValue.value;
-    }
-    if (isInitializer) {
-        return closure->getAt(0, "this");
-    }
-
-    return Null{};
+    return interpreter->call(this, arguments);
 }
 
-std::shared_ptr<Function> Function::bind(std::shared_ptr<Instance> instance)
+CallablePtr Function::bind(InstancePtr instance)
 {
-    EnvironmentPtr env = std::make_shared<Environment>(closure);
-    env->define("this", std::move(instance));
-    return std::make_shared<Function>(declaration, env, isInitializer);
+    Roots roots;
+    roots.add(instance);
+    auto *bound = make<Function>(declaration, upvalues, isInitializer);
+    bound->receiver = instance;
+    return bound;
 }
 
 }  // namespace object
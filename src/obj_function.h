@@ -2,32 +2,43 @@
 
 #include "environment.h"
 #include "obj_callable.h"
+#include "obj_closure.h"
 
 namespace draft {
 class FuncStmt;
 
-class ReturnEx : public std::runtime_error {
-public:
-    explicit ReturnEx(object::Object value);
-    object::Object value;
-};
-
 namespace object {
-class Function : public Callable {
+// A function of the tree-walker. It holds the cells of the variables it captures rather than the
+// scopes they were declared in
+class Function final : public Method {
 public:
-    Function(FuncStmt *declaration, EnvironmentPtr closure, bool isInitializer = false);
+    Function(FuncStmt *declaration, std::vector<UpvaluePtr> upvalues, bool isInitializer = false);
+
+    void trace(Heap &heap) override;
     std::size_t arity() override;
-    object::Object call(Interpreter *interpreter, std::vector<Object> arguments) override;
+    object::Value call(Interpreter *interpreter, Arguments arguments) override;
 
-    std::shared_ptr<Function> bind(std::shared_ptr<Instance> instance);
+    CallablePtr bind(InstancePtr instance) override;
+
+    FuncStmt *code() const
+    {
+        return declaration;
+    }
+
+    // One per FuncStmt::captures
+    std::vector<UpvaluePtr> upvalues;
 
 private:
+    // Runs the calls, see Interpreter::enter()
+    friend class draft::Interpreter;
+
     FuncStmt *declaration = nullptr;
-    EnvironmentPtr closure;
+    // Set on bound methods, and passed in the first slot. Methods are only ever called bound
+    InstancePtr receiver = nullptr;
     bool isInitializer = false;
 };
 
-using FunctionPtr = std::shared_ptr<Function>;
+using FunctionPtr = Function *;
 
 }  // namespace object
 }  // namespace draft
@@ -1,28 +1,102 @@
 #include "obj_instance.h"
 
+#include <algorithm>
+
+#include "heap.h"
+
 namespace draft::object {
 
-Instance::Instance(Class klass)
-    : klass{std::move(klass)}
+Instance::Instance(ClassPtr klass)
+    : Obj{Kind::Instance}
+    , klass{klass}
+    , shape{klass->shape}
+{
+    fields.reserve(shape->expectedSize);
+}
+
+void Instance::trace(Heap &heap)
 {
+    heap.mark(klass);
+    heap.mark(shape);
+    for (const Value &value : fields) {
+        heap.mark(value);
+    }
 }
 
-Object Instance::getProperty(std::string name)
+Value Instance::getProperty(String *name, InlineCache &cache)
 {
-    if (fields.contains(name)) {
-        return fields.at(name);
+    if (const auto *entry = cache.find(shape)) {
+        if (entry->method) {
+            return entry->method->bind(InstancePtr{this});
+        }
+        return fields[entry->offset];
     }
 
-    FunctionPtr method = klass.findMethod(name);
+    if (auto offset = shape->find(name)) {
+        cache.add(shape, {.offset = *offset});
+        return fields[*offset];
+    }
+    MethodPtr method = klass->findMethod(name);
     if (method) {
-        return method->bind(shared_from_this());
+        cache.add(shape, {.method = method});
+        return method->bind(InstancePtr{this});
     }
     return Null{};
 }
 
-void Instance::setProperty(std::string name, const Object &value)
+MethodPtr Instance::getMethod(String *name, InlineCache &cache)
 {
-    fields[name] = value;
+    if (const auto *entry = cache.find(shape)) {
+        return entry->method;
+    }
+
+    if (auto offset = shape->find(name)) {
+        cache.add(shape, {.offset = *offset});
+        return nullptr;
+    }
+    MethodPtr method = klass->findMethod(name);
+    if (method) {
+        cache.add(shape, {.method = method});
+    }
+    return method;
+}
+
+void Instance::setProperty(String *name, const Value &value, InlineCache &cache)
+{
+    if (const auto *entry = cache.find(shape)) {
+        if (entry->next) {
+            addField(entry->next, value);
+        } else {
+            fields[entry->offset] = value;
+        }
+        return;
+    }
+
+    if (auto offset = shape->find(name)) {
+        cache.add(shape, {.offset = *offset});
+        fields[*offset] = value;
+        return;
+    }
+    ShapePtr previous = shape;
+    ShapePtr next;
+    {
+        // Moving to the next shape may allocate
+        Roots roots;
+        roots.add(this);
+        roots.add(value);
+        next = shape->transition(name);
+    }
+    cache.add(previous, {.next = next});
+    addField(next, value);
+}
+
+void Instance::addField(ShapePtr next, const Value &value)
+{
+    shape = next;
+    fields.push_back(value);
+
+    ShapePtr root = klass->shape;
+    root->expectedSize = std::max(root->expectedSize, fields.size());
 }
 
 }  // namespace draft::object
@@ -1,21 +1,51 @@
 #pragma once
 
-#include <map>
+#include <cstdint>
+#include <optional>
 
+#include "inline_cache.h"
 #include "obj_class.h"
 
 namespace draft::object {
 
-class Instance : public std::enable_shared_from_this<Instance> {
+class Instance : public Obj {
 public:
-    explicit Instance(Class klass);
+    explicit Instance(ClassPtr klass);
 
-    Object getProperty(std::string name);
-    void setProperty(std::string name, const object::Object &value);
+    void trace(Heap &heap) override;
+
+    // The site's cache is consulted first and learns the outcome of a full lookup
+    Value getProperty(String *name, InlineCache &cache);
+    void setProperty(String *name, const object::Value &value, InlineCache &cache);
+    // The method a call of the property invokes on the instance, without binding it. Null if the
+    // property is a field or not there, getProperty() then has its value
+    MethodPtr getMethod(String *name, InlineCache &cache);
+
+    // Direct field access for sites specialized on the shape of the instance
+    std::uint64_t shapeId() const
+    {
+        return shape->id;
+    }
+    std::optional<std::uint32_t> findField(String *name) const
+    {
+        return shape->find(name);
+    }
+    const Value &field(std::uint32_t offset) const
+    {
+        return fields[offset];
+    }
 
 private:
-    Class klass;
-    std::map<std::string, Object> fields;
+    void addField(ShapePtr next, const Value &value);
+
+    ClassPtr klass = nullptr;
+    ShapePtr shape = nullptr;
+    std::vector<Value> fields;  // laid out as described by shape
 };
 
+inline Instance *Value::asInstance() const
+{
+    return static_cast<Instance *>(asObj());
+}
+
 }  // namespace draft::object
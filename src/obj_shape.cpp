@@ -0,0 +1,66 @@
+#include "obj_shape.h"
+
+#include <algorithm>
+
+#include "heap.h"
+
+namespace draft::object {
+
+Shape::Shape()
+    : Obj{Kind::Shape}
+    , id{++lastId}
+{
+}
+
+void Shape::trace(Heap &heap)
+{
+    for (String *name : names) {
+        heap.mark(name);
+    }
+    for (const auto &[name, next] : transitions) {
+        heap.mark(name);
+        heap.mark(next);
+    }
+}
+
+std::optional<std::uint32_t> Shape::find(String *name) const
+{
+    if (names.size() > MaxLinearSearch) {
+        if (auto it = offsets.find(name); it != offsets.end()) {
+            return it->second;
+        }
+        return std::nullopt;
+    }
+    auto it = std::find(names.begin(), names.end(), name);
+    if (it == names.end()) {
+        return std::nullopt;
+    }
+    return static_cast<std::uint32_t>(it - names.begin());
+}
+
+ShapePtr Shape::transition(String *name)
+{
+    auto it = std::find_if(transitions.begin(), transitions.end(),
+                           [name](const auto &transition) { return transition.first == name; });
+    if (it != transitions.end()) {
+        return it->second;
+    }
+
+    auto *next = make<Shape>();
+    next->names = names;
+    next->names.push_back(name);
+    if (next->names.size() > MaxLinearSearch) {
+        for (std::uint32_t offset = 0; offset < next->names.size(); ++offset) {
+            next->offsets.emplace(next->names[offset], offset);
+        }
+    }
+    transitions.emplace_back(name, next);
+    return next;
+}
+
+std::size_t Shape::size() const
+{
+    return names.size();
+}
+
+}  // namespace draft::object
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "object.h"
+
+namespace draft::object {
+class Shape;
+using ShapePtr = Shape *;
+
+// Hidden class describing the layout of instance fields: which field names an instance has and at
+// which offset each value is stored. Instances that gained the same fields in the same order share
+// a shape, and adding a field moves an instance along a transition to the next shape
+class Shape : public Obj {
+public:
+    Shape();
+
+    // Shapes are told apart by id rather than address in caches, as the address of a collected
+    // shape may be reused by a new one
+    const std::uint64_t id;
+
+    void trace(Heap &heap) override;
+
+    std::optional<std::uint32_t> find(String *name) const;
+    // The shape with name appended, shared by everyone who adds the same field here
+    ShapePtr transition(String *name);
+
+    std::size_t size() const;
+
+    // Most fields an instance starting from this root shape has ended up with, used to size the
+    // field storage of new instances up front
+    std::size_t expectedSize = 0;
+
+private:
+    static inline std::uint64_t lastId = 0;
+
+    // Up to this many fields a linear scan beats hashing
+    static constexpr std::size_t MaxLinearSearch = 8;
+
+    std::vector<String *> names;
+    SymbolMap<std::uint32_t> offsets;  // only filled past MaxLinearSearch
+    std::vector<std::pair<String *, ShapePtr>> transitions;
+};
+
+}  // namespace draft::object
@@ -1,56 +1,108 @@
 #include "object.h"
 
-#include <iostream>
-#include <stdexcept>
+#include <functional>
+
+#include "heap.h"
 
 namespace draft::object {
 
-std::string obj2str(const Object &obj)
-{
-    auto visitor = [](auto &&arg) -> std::string {
-        using T = std::decay_t<decltype(arg)>;
-        std::string ret;
-        if constexpr (std::is_same_v<T, String>) {
-            ret = arg;
-        } else if constexpr (std::is_same_v<T, Number>) {
-            ret = std::to_string(arg);
-        } else if constexpr (std::is_same_v<T, Boolean>) {
-            ret = arg ? "true" : "false";
-        } else if constexpr (std::is_same_v<T, Null>) {
-            ret = "nil";
-        } else if constexpr (std::is_same_v<T, CallablePtr>) {
-            ret = "callable";
-        } else if constexpr (std::is_same_v<T, InstancePtr>) {
-            ret = "instance";
-        } else {
-            throw std::runtime_error{"Unknown Object type"};
-        }
-        return ret;
+Obj::Obj(Kind kind)
+    : kind{kind}
+{
+}
+
+void Obj::trace(Heap &)
+{
+}
+
+namespace {
+
+// Maps characters to the live String holding them. Strings unregister themselves when the
+// collector frees them, so the table never keeps one alive
+std::unordered_map<std::string_view, String *> &internTable()
+{
+    // Never destroyed, strings held by other statics may die after it would have been
+    static auto *table = new std::unordered_map<std::string_view, String *>;
+    return *table;
+}
+
+}  // namespace
+
+StringPtr intern(std::string_view chars)
+{
+    auto &table = internTable();
+    if (auto it = table.find(chars); it != table.end()) {
+        return it->second;
+    }
+    auto *string = new String{std::string{chars}, std::hash<std::string_view>{}(chars)};
+    // The key views the string's own characters, which never change
+    table.emplace(string->chars, string);
+    heap().adopt(string, sizeof(String) + string->chars.size());
+    return string;
+}
+
+String::String(std::string chars, std::size_t hash)
+    : Obj{Kind::String}
+    , chars{std::move(chars)}
+    , hash{hash}
+{
+}
+
+String::~String()
+{
+    internTable().erase(chars);
+}
+
+const Symbols &symbols()
+{
+    auto pinned = [](std::string_view name) {
+        StringPtr symbol = intern(name);
+        heap().pin(symbol);
+        return symbol;
     };
-    return std::visit(visitor, obj);
+    static const Symbols symbols{pinned("init"), pinned("this"), pinned("super")};
+    return symbols;
+}
+
+std::string obj2str(const Value &value)
+{
+    if (value.isNumber()) {
+        return std::to_string(value.asNumber());
+    }
+    if (value.isBool()) {
+        return value.asBool() ? "true" : "false";
+    }
+    if (value.isNil()) {
+        return "nil";
+    }
+    if (value.isString()) {
+        return value.asString()->chars;
+    }
+    if (value.isInstance()) {
+        return "instance";
+    }
+    return "callable";
 }
 
 // false and nil are falsey, and everything else is truthy
-bool isTruthy(const Object &obj)
+bool isTruthy(const Value &value)
 {
-    if (std::holds_alternative<Null>(obj)) {
+    if (value.isNil()) {
         return false;
     }
-    if (std::holds_alternative<Boolean>(obj)) {
-        return std::get<bool>(obj);
+    if (value.isBool()) {
+        return value.asBool();
     }
     return true;
 }
 
-bool isEqual(const Object &a, const Object &b)
+bool isEqual(const Value &a, const Value &b)
 {
-    if (std::holds_alternative<Null>(a) and std::holds_alternative<Null>(b)) {
-        return true;
-    }
-    if (std::holds_alternative<Null>(a)) {
-        return false;
+    if (a.isNumber() and b.isNumber()) {
+        return a.asNumber() == b.asNumber();
     }
-    return a == b;
+    // Strings are interned, equal strings are the same object
+    return a.raw() == b.raw();
 }
 
 }  // namespace draft::object
@@ -1,9 +1,11 @@
 #pragma once
 
-#include <functional>
-#include <memory>
+#include <cstdint>
+#include <cstring>
 #include <string>
-#include <variant>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 namespace draft {
@@ -14,17 +16,196 @@ namespace object {
 class Callable;
 class Instance;
 
-using Null = std::monostate;
+class Heap;
+
+// Base of everything the collector manages. Objects are owned by the Heap, a reference is a bare
+// pointer and fits into the payload of a NaN-boxed Value
+class Obj {
+public:
+    // Callable kinds are kept last, see Value::isCallable()
+    enum class Kind : std::uint8_t {
+        String,
+        Instance,
+        Environment,
+        Upvalue,
+        Prototype,
+        Shape,
+        Function,
+        Closure,
+        BoundMethod,
+        Native,
+        Class
+    };
+
+    explicit Obj(Kind kind);
+    Obj(const Obj &) = delete;
+    Obj &operator=(const Obj &) = delete;
+    virtual ~Obj() = default;
+
+    // Marks the objects this one refers to
+    virtual void trace(Heap &heap);
+
+    const Kind kind;
+
+private:
+    friend class Heap;
+
+    Obj *next = nullptr;  // all objects of the heap are chained through here
+    std::uint32_t size = 0;
+    bool marked = false;
+    bool pinned = false;
+};
+
+class String;
+using StringPtr = String *;
+
+// Returns the single String holding chars, creating it on first use
+StringPtr intern(std::string_view chars);
+
+// Immutable interned string. There is at most one String per character sequence, so strings are
+// equal exactly when they are the same object and can serve as symbols for name lookups
+class String : public Obj {
+public:
+    ~String() override;
+
+    const std::string chars;
+    const std::size_t hash;
+
+private:
+    String(std::string chars, std::size_t hash);
+
+    friend StringPtr intern(std::string_view chars);
+};
+
+// Interned strings are compared by identity, hashing reads the cached hash
+struct SymbolHash {
+    std::size_t operator()(const String *symbol) const
+    {
+        return symbol->hash;
+    }
+};
+
+template <typename T>
+using SymbolMap = std::unordered_map<StringPtr, T, SymbolHash>;
+
+// Interned names the runtime refers to by itself
+struct Symbols {
+    StringPtr init;
+    StringPtr thisName;
+    StringPtr superName;
+};
+
+const Symbols &symbols();
+using CallablePtr = Callable *;
+using InstancePtr = Instance *;
+
+struct Null {};
 using Boolean = bool;
-using String = std::string;
 using Number = double;
-using CallablePtr = std::shared_ptr<Callable>;
-using InstancePtr = std::shared_ptr<Instance>;
-using Object = std::variant<Null, Boolean, String, Number, CallablePtr, InstancePtr>;
 
-std::string obj2str(const Object &obj);
-bool isTruthy(const Object &obj);
-bool isEqual(const Object &a, const Object &b);
+// A 64-bit value. Numbers are stored as plain doubles; everything else hides in the payload of a
+// quiet NaN that arithmetic never produces:
+//
+//   nil, booleans  0 11111111111 11 ... tag
+//   objects        1 11111111111 11 ... 48-bit pointer
+class Value {
+public:
+    Value()
+        : bits{NilBits}
+    {
+    }
+    Value(Null)
+        : bits{NilBits}
+    {
+    }
+    Value(Boolean boolean)
+        : bits{boolean ? TrueBits : FalseBits}
+    {
+    }
+    Value(Number number)
+    {
+        std::memcpy(&bits, &number, sizeof(Number));
+    }
+    Value(Obj *obj)
+        : bits{SignBit | QuietNaN | reinterpret_cast<std::uintptr_t>(obj)}
+    {
+    }
+    // Catches other pointers that would otherwise silently convert to a boolean
+    Value(const void *) = delete;
+
+    bool isNil() const
+    {
+        return bits == NilBits;
+    }
+    bool isBool() const
+    {
+        return (bits | 1) == TrueBits;
+    }
+    bool isNumber() const
+    {
+        return (bits & QuietNaN) != QuietNaN;
+    }
+    bool isObj() const
+    {
+        return (bits & (QuietNaN | SignBit)) == (QuietNaN | SignBit);
+    }
+    bool isString() const
+    {
+        return isObj() and asObj()->kind == Obj::Kind::String;
+    }
+    bool isInstance() const
+    {
+        return isObj() and asObj()->kind == Obj::Kind::Instance;
+    }
+    bool isCallable() const
+    {
+        return isObj() and asObj()->kind >= Obj::Kind::Function;
+    }
+
+    Boolean asBool() const
+    {
+        return bits == TrueBits;
+    }
+    Number asNumber() const
+    {
+        Number number;
+        std::memcpy(&number, &bits, sizeof(Number));
+        return number;
+    }
+    Obj *asObj() const
+    {
+        return reinterpret_cast<Obj *>(static_cast<std::uintptr_t>(bits & ~(SignBit | QuietNaN)));
+    }
+    String *asString() const
+    {
+        return static_cast<String *>(asObj());
+    }
+    // Defined next to the classes they cast to
+    Callable *asCallable() const;
+    Instance *asInstance() const;
+
+    // Bit pattern, identical for identical values
+    std::uint64_t raw() const
+    {
+        return bits;
+    }
+
+private:
+    static constexpr std::uint64_t SignBit = 0x8000000000000000;
+    static constexpr std::uint64_t QuietNaN = 0x7ffc000000000000;
+    static constexpr std::uint64_t NilBits = QuietNaN | 1;
+    static constexpr std::uint64_t FalseBits = QuietNaN | 2;
+    static constexpr std::uint64_t TrueBits = QuietNaN | 3;
+
+    std::uint64_t bits;
+};
+
+static_assert(sizeof(Value) == sizeof(std::uint64_t));
+static_assert(std::is_trivially_copyable_v<Value>);
+
+std::string obj2str(const Value &value);
+bool isTruthy(const Value &value);
+bool isEqual(const Value &a, const Value &b);
 
 }  // namespace object
 }  // namespace draft
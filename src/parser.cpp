@@ -1,6 +1,9 @@
 #include "parser.h"
 
+#include <charconv>
+
 #include "driver.h"
+#include "heap.h"
 
 namespace draft {
 
@@ -27,8 +30,9 @@ Nonterminal       Call to that rule's function
 * or +            while of for loop
 ?                 if statement
 */
-Parser::Parser(const std::vector<Token> &tokens)
-    : tokens{tokens}
+Parser::Parser(const std::vector<Token> &tokens, memory::Arena &arena)
+    : arena{arena}
+    , tokens{tokens}
 {
 }
 
@@ -207,8 +211,18 @@ Expr *Parser::primary()
     if (match(Token::Kind::Nil)) {
         return makeAstNode<Literal>(object::Null{});
     }
-    if (match(Token::Kind::NumberLiteral, Token::Kind::StringLiteral)) {
-        return makeAstNode<Literal>(previous().literal);
+    if (match(Token::Kind::NumberLiteral)) {
+        std::string_view lexeme = previous().lexeme();
+        double value = 0;
+        std::from_chars(lexeme.data(), lexeme.data() + lexeme.size(), value);
+        return makeAstNode<Literal>(object::Number{value});
+    }
+    if (match(Token::Kind::StringLiteral)) {
+        // Without the surrounding quotes. Like names, the string stays alive for good
+        std::string_view lexeme = previous().lexeme();
+        object::StringPtr string = object::intern(lexeme.substr(1, lexeme.size() - 2));
+        object::heap().pin(string);
+        return makeAstNode<Literal>(string);
     }
     if (match(Token::Kind::Super)) {
         Token keyword = previous();
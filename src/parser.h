@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdexcept>
 #include <vector>
 
 #include "ast.h"
@@ -16,7 +17,8 @@ public:
 
 class Parser {
 public:
-    explicit Parser(const std::vector<Token> &tokens);
+    // The nodes are allocated in arena, which has to outlive whatever runs the syntax tree
+    Parser(const std::vector<Token> &tokens, memory::Arena &arena);
 
     std::vector<Stmt *> parse();
 
@@ -92,7 +94,7 @@ private:
         return node;
     }
 
-    memory::Arena arena;
+    memory::Arena &arena;
 
     const std::vector<Token> &tokens;
     std::size_t current = 0;
@@ -0,0 +1,709 @@
+#include "register_compiler.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "driver.h"
+
+namespace draft {
+
+constexpr int MaxRegisters = Instruction::MaxA + 1;
+constexpr std::size_t MaxUpvalues = std::numeric_limits<std::uint8_t>::max() + 1;
+constexpr std::size_t MaxConstants = std::numeric_limits<std::uint16_t>::max() + 1;
+constexpr std::size_t MaxCaches = std::numeric_limits<std::uint16_t>::max() + 1;
+
+namespace {
+
+// Whether evaluating expr may assign a variable, directly or by calling code that does
+bool hasEffects(Expr *expr)
+{
+    if (auto *logical = dynamic_cast<Logical *>(expr)) {
+        return hasEffects(logical->left) or hasEffects(logical->right);
+    }
+    if (auto *binary = dynamic_cast<Binary *>(expr)) {
+        return hasEffects(binary->left) or hasEffects(binary->right);
+    }
+    if (auto *unary = dynamic_cast<Unary *>(expr)) {
+        return hasEffects(unary->right);
+    }
+    if (auto *grouping = dynamic_cast<Grouping *>(expr)) {
+        return hasEffects(grouping->expression);
+    }
+    if (auto *get = dynamic_cast<Get *>(expr)) {
+        return hasEffects(get->object);
+    }
+    return dynamic_cast<Call *>(expr) or dynamic_cast<Assign *>(expr) or dynamic_cast<Set *>(expr);
+}
+
+}  // namespace
+
+RegisterCompiler::RegisterCompiler()
+{
+    object::heap().addRoots(this);
+}
+
+RegisterCompiler::~RegisterCompiler()
+{
+    object::heap().removeRoots(this);
+}
+
+void RegisterCompiler::markRoots(object::Heap &heap)
+{
+    for (FunctionState *state = current; state; state = state->enclosing) {
+        heap.mark(state->prototype);
+    }
+}
+
+object::PrototypePtr RegisterCompiler::compile(const std::vector<Stmt *> &statements)
+{
+    FunctionState script;
+    script.prototype = object::make<object::Prototype>("script");
+    current = &script;
+    // Register zero of every frame belongs to the function being called
+    addLocal("", allocate());
+
+    for (Stmt *stmt : statements) {
+        compile(stmt);
+    }
+    emitReturn();
+
+    current = nullptr;
+    return script.prototype;
+}
+
+object::Value RegisterCompiler::visit(Literal *expr)
+{
+    if (expr->value.isNil()) {
+        emit(Instruction::abc(RegisterOp::Nil, target));
+    } else if (expr->value.isBool()) {
+        emit(Instruction::abc(RegisterOp::Boolean, target, expr->value.asBool()));
+    } else {
+        emit(Instruction::abx(RegisterOp::Constant, target, makeConstant(expr->value)));
+    }
+    return object::Null{};
+}
+
+object::Value RegisterCompiler::visit(Logical *expr)
+{
+    // The right operand may read a variable the result is assigned to, which must not change early
+    int result = target;
+    if (std::any_of(current->locals.begin(), current->locals.end(),
+                    [this](const Local &local) { return local.reg == target; })) {
+        result = allocate();
+    }
+
+    compile(expr->left, result);
+    line = expr->op.line;
+    std::size_t endJump =
+        emitJump(expr->op.kind == Token::Kind::Or ? RegisterOp::JumpIfTrue : RegisterOp::JumpIfFalse, result);
+    compile(expr->right, result);
+    patchJump(endJump);
+
+    if (result != target) {
+        emit(Instruction::abc(RegisterOp::Move, target, result));
+    }
+    return object::Null{};
+}
+
+object::Value RegisterCompiler::visit(Unary *expr)
+{
+    int operand = compileAny(expr->right);
+    line = expr->op.line;
+
+    switch (expr->op.kind) {
+    case Token::Kind::HyphenMinus:
+        emit(Instruction::abc(RegisterOp::Negate, target, operand));
+        break;
+    case Token::Kind::ExclamationMark:
+        emit(Instruction::abc(RegisterOp::Not, target, operand));
+        break;
+    default:
+        break;
+    }
+    return object::Null{};
+}
+
+object::Value RegisterCompiler::visit(Binary *expr)
+{
+    int left = compileOperand(expr->left, expr->right);
+    int right = compileOperand(expr->right);
+    line = expr->op.line;
+
+    RegisterOp op = RegisterOp::Add;
+    switch (expr->op.kind) {
+    case Token::Kind::GreaterThanSign:
+        op = RegisterOp::Greater;
+        break;
+    case Token::Kind::GreaterEqual:
+        op = RegisterOp::GreaterEqual;
+        break;
+    case Token::Kind::LessThanSign:
+        op = RegisterOp::Less;
+        break;
+    case Token::Kind::LessEqual:
+        op = RegisterOp::LessEqual;
+        break;
+    case Token::Kind::ExclaimEqual:
+        op = RegisterOp::NotEqual;
+        break;
+    case Token::Kind::EqualEqual:
+        op = RegisterOp::Equal;
+        break;
+    case Token::Kind::HyphenMinus:
+        op = RegisterOp::Subtract;
+        break;
+    case Token::Kind::PlusSign:
+        op = RegisterOp::Add;
+        break;
+    case Token::Kind::Solidus:
+        op = RegisterOp::Divide;
+        break;
+    case Token::Kind::Asterisk:
+        op = RegisterOp::Multiply;
+        break;
+    default:
+        break;
+    }
+    emit(Instruction::abc(op, target, left, right));
+    return object::Null{};
+}
+
+object::Value RegisterCompiler::visit(Call *expr)
+{
+    // The callee and the arguments go to consecutive registers, the callee's register receives the
+    // result. A target on top of the temporaries can serve as the first of them
+    int base = target == current->freeRegister - 1 ? target : allocate();
+    if (std::any_of(current->locals.begin(), current->locals.end(),
+                    [base](const Local &local) { return local.reg == base; })) {
+        base = allocate();
+    }
+
+    // A method is called on the receiver in place of the callee, without binding it
+    auto *get = expr->callee->kind == Expr::Kind::Get ? static_cast<Get *>(expr->callee) : nullptr;
+    compile(get ? get->object : expr->callee, base);
+    for (Expr *argument : expr->arguments) {
+        compile(argument, allocate());
+    }
+    line = expr->paren.line;
+    // The Return that follows a tail call only runs if the callee could not take over the frame
+    auto argCount = static_cast<std::uint32_t>(expr->arguments.size());
+    if (get) {
+        emit(Instruction::abc(expr->tail ? RegisterOp::TailInvoke : RegisterOp::Invoke, base, argCount));
+        emitCache(identifierConstant(get->name.lexeme()));
+    } else {
+        emit(Instruction::abc(expr->tail ? RegisterOp::TailCall : RegisterOp::Call, base, argCount));
+    }
+    emitCache();
+
+    if (base != target) {
+        emit(Instruction::abc(RegisterOp::Move, target, base));
+    }
+    return object::Null{};
+}
+
+object::Value RegisterCompiler::visit(Grouping *expr)
+{
+    compile(expr->expression, target);
+    return object::Null{};
+}
+
+object::Value RegisterCompiler::visit(Variable *expr)
+{
+    line = expr->name.line;
+    std::string_view name = expr->name.lexeme();
+    if (int reg = resolveLocal(current, name); reg != -1) {
+        if (reg != target) {
+            emit(Instruction::abc(RegisterOp::Move, target, reg));
+        }
+    } else if (int index = resolveUpvalue(current, name); index != -1) {
+        emit(Instruction::abc(RegisterOp::GetUpvalue, target, index));
+    } else {
+        emit(Instruction::abx(RegisterOp::GetGlobal, target, identifierConstant(name)));
+    }
+    return object::Null{};
+}
+
+object::Value RegisterCompiler::visit(Assign *expr)
+{
+    std::string_view name = expr->name.lexeme();
+    if (int reg = resolveLocal(current, name); reg != -1) {
+        compile(expr->value, reg);
+        if (reg != target) {
+            emit(Instruction::abc(RegisterOp::Move, target, reg));
+        }
+        return object::Null{};
+    }
+
+    compile(expr->value, target);
+    line = expr->name.line;
+    if (int index = resolveUpvalue(current, name); index != -1) {
+        emit(Instruction::abc(RegisterOp::SetUpvalue, target, index));
+    } else {
+        emit(Instruction::abx(RegisterOp::SetGlobal, target, identifierConstant(name)));
+    }
+    return object::Null{};
+}
+
+object::Value RegisterCompiler::visit(Get *expr)
+{
+    int object = compileAny(expr->object);
+    line = expr->name.line;
+    emit(Instruction::abc(RegisterOp::GetProperty, target, object));
+    emitCache(identifierConstant(expr->name.lexeme()));
+    return object::Null{};
+}
+
+object::Value RegisterCompiler::visit(Set *expr)
+{
+    int object = compileAny(expr->object);
+    if (object == localRegister(expr->object) and hasEffects(expr->value)) {
+        object = allocate();
+        emit(Instruction::abc(RegisterOp::Move, object, localRegister(expr->object)));
+    }
+    int value = compileAny(expr->value);
+    line = expr->name.line;
+    emit(Instruction::abc(RegisterOp::SetProperty, object, value));
+    emitCache(identifierConstant(expr->name.lexeme()));
+
+    if (value != target) {
+        emit(Instruction::abc(RegisterOp::Move, target, value));
+    }
+    return object::Null{};
+}
+
+object::Value RegisterCompiler::visit(Super *expr)
+{
+    line = expr->keyword.line;
+    int receiver = variable("this");
+    int superclass = variable("super");
+    emit(Instruction::abc(RegisterOp::GetSuper, target, receiver, superclass));
+    emitExtra(expr->method.lexeme());
+    return object::Null{};
+}
+
+object::Value RegisterCompiler::visit(This *expr)
+{
+    line = expr->keyword.line;
+    int reg = variable("this");
+    if (reg != target) {
+        emit(Instruction::abc(RegisterOp::Move, target, reg));
+    }
+    return object::Null{};
+}
+
+void RegisterCompiler::visit(ExprStmt *stmt)
+{
+    compileAny(stmt->expression);
+}
+
+void RegisterCompiler::visit(If *stmt)
+{
+    std::size_t thenJump = emitJump(RegisterOp::JumpIfFalse, compileAny(stmt->condition));
+    releaseTemporaries();
+    compile(stmt->thenBranch);
+
+    if (!stmt->elseBranch) {
+        patchJump(thenJump);
+        return;
+    }
+    std::size_t elseJump = emitJump(RegisterOp::Jump);
+    patchJump(thenJump);
+    compile(stmt->elseBranch);
+    patchJump(elseJump);
+}
+
+void RegisterCompiler::visit(FuncStmt *stmt)
+{
+    line = stmt->name.line;
+    int reg = allocate();
+    if (current->scopeDepth > 0) {
+        // A local function can refer to itself before its body is compiled
+        addLocal(stmt->name.lexeme(), reg);
+        function(stmt, FunctionType::Function, reg);
+        return;
+    }
+    function(stmt, FunctionType::Function, reg);
+    emit(Instruction::abx(RegisterOp::DefineGlobal, reg, identifierConstant(stmt->name.lexeme())));
+}
+
+void RegisterCompiler::visit(Print *stmt)
+{
+    emit(Instruction::abc(RegisterOp::Print, compileAny(stmt->expression)));
+}
+
+void RegisterCompiler::visit(Return *stmt)
+{
+    line = stmt->keyword.line;
+    if (!stmt->value) {
+        emitReturn();
+        return;
+    }
+    emit(Instruction::abc(RegisterOp::Return, compileAny(stmt->value)));
+}
+
+void RegisterCompiler::visit(While *stmt)
+{
+    std::size_t loopStart = chunk().instructions.size();
+    std::size_t exitJump = emitJump(RegisterOp::JumpIfFalse, compileAny(stmt->condition));
+    releaseTemporaries();
+    compile(stmt->body);
+    emitLoop(loopStart);
+    patchJump(exitJump);
+}
+
+void RegisterCompiler::visit(Block *stmt)
+{
+    beginScope();
+    for (Stmt *s : stmt->statements) {
+        compile(s);
+    }
+    endScope();
+}
+
+void RegisterCompiler::visit(Class *stmt)
+{
+    line = stmt->name.line;
+    std::string_view className = stmt->name.lexeme();
+    std::uint16_t nameConstant = identifierConstant(className);
+
+    int klass = allocate();
+    emit(Instruction::abx(RegisterOp::Class, klass, nameConstant));
+    if (current->scopeDepth > 0) {
+        addLocal(className, klass);
+    } else {
+        emit(Instruction::abx(RegisterOp::DefineGlobal, klass, nameConstant));
+    }
+
+    if (stmt->superclass) {
+        // Methods capture the superclass through a local named "super"
+        beginScope();
+        int superclass = allocate();
+        compile(stmt->superclass, superclass);
+        addLocal("super", superclass);
+        emit(Instruction::abc(RegisterOp::Inherit, klass, superclass));
+    }
+
+    for (FuncStmt *method : stmt->methods) {
+        line = method->name.line;
+        FunctionType type = method->name.lexeme() == "init" ? FunctionType::Initializer : FunctionType::Method;
+        int closure = allocate();
+        function(method, type, closure);
+        emit(Instruction::abc(RegisterOp::Method, klass, closure));
+        emitExtra(method->name.lexeme());
+        current->freeRegister = closure;
+    }
+
+    if (stmt->superclass) {
+        endScope();
+    }
+}
+
+void RegisterCompiler::visit(Var *stmt)
+{
+    line = stmt->name.line;
+    int reg = allocate();
+    if (stmt->initializer) {
+        compile(stmt->initializer, reg);
+    } else {
+        emit(Instruction::abc(RegisterOp::Nil, reg));
+    }
+
+    if (current->scopeDepth > 0) {
+        addLocal(stmt->name.lexeme(), reg);
+    } else {
+        line = stmt->name.line;
+        emit(Instruction::abx(RegisterOp::DefineGlobal, reg, identifierConstant(stmt->name.lexeme())));
+    }
+}
+
+void RegisterCompiler::compile(Stmt *stmt)
+{
+    if (stmt) {
+        stmt->accept(this);
+        // Statements leave nothing behind but the locals they declare
+        releaseTemporaries();
+    }
+}
+
+void RegisterCompiler::compile(Expr *expr, int reg)
+{
+    int freeRegister = current->freeRegister;
+    int enclosingTarget = target;
+    target = reg;
+    if (expr) {
+        expr->accept(this);
+    } else {
+        emit(Instruction::abc(RegisterOp::Nil, reg));
+    }
+    target = enclosingTarget;
+    current->freeRegister = freeRegister;
+}
+
+int RegisterCompiler::compileAny(Expr *expr)
+{
+    if (int reg = localRegister(expr); reg != -1) {
+        return reg;
+    }
+    if (auto *assign = dynamic_cast<Assign *>(expr)) {
+        if (int reg = resolveLocal(current, assign->name.lexeme()); reg != -1) {
+            compile(expr, reg);
+            return reg;
+        }
+    }
+    int reg = allocate();
+    compile(expr, reg);
+    return reg;
+}
+
+int RegisterCompiler::compileOperand(Expr *expr, Expr *later)
+{
+    auto *literal = dynamic_cast<Literal *>(expr);
+    if (literal and (literal->value.isNumber() or literal->value.isString())) {
+        std::uint16_t constant = makeConstant(literal->value);
+        if (constant < Instruction::ConstantBit) {
+            return static_cast<int>(Instruction::ConstantBit + constant);
+        }
+    }
+    int reg = compileAny(expr);
+    if (later and reg == localRegister(expr) and hasEffects(later)) {
+        int copy = allocate();
+        emit(Instruction::abc(RegisterOp::Move, copy, reg));
+        return copy;
+    }
+    return reg;
+}
+
+void RegisterCompiler::function(FuncStmt *stmt, FunctionType type, int reg)
+{
+    FunctionState state;
+    state.enclosing = current;
+    state.type = type;
+    state.prototype = object::make<object::Prototype>(std::string{stmt->name.lexeme()});
+    state.prototype->arity = stmt->params.size();
+    current = &state;
+
+    // Methods receive the instance in register zero
+    addLocal(type == FunctionType::Function ? "" : "this", allocate());
+    beginScope();
+    for (const Token &param : stmt->params) {
+        line = param.line;
+        addLocal(param.lexeme(), allocate());
+    }
+    for (Stmt *s : stmt->body) {
+        compile(s);
+    }
+    emitReturn();
+
+    current = state.enclosing;
+
+    state.prototype->upvalueCount = state.upvalues.size();
+    std::size_t index = chunk().addPrototype(state.prototype);
+    if (index > Instruction::MaxBx) {
+        error("Too many functions in one chunk");
+    }
+    emit(Instruction::abx(RegisterOp::Closure, reg, static_cast<std::uint32_t>(index)));
+    for (const Upvalue &upvalue : state.upvalues) {
+        emit(Instruction::abc(RegisterOp::Move, upvalue.isLocal ? 1 : 0, upvalue.index));
+    }
+}
+
+int RegisterCompiler::allocate()
+{
+    int reg = current->freeRegister++;
+    if (reg >= MaxRegisters) {
+        error("Too many registers needed in function");
+        return 0;
+    }
+    auto &count = current->prototype->registerCount;
+    count = std::max(count, static_cast<std::size_t>(current->freeRegister));
+    return reg;
+}
+
+void RegisterCompiler::releaseTemporaries()
+{
+    current->freeRegister = current->locals.back().reg + 1;
+}
+
+int RegisterCompiler::localRegister(Expr *expr)
+{
+    if (auto *variable = dynamic_cast<Variable *>(expr)) {
+        return resolveLocal(current, variable->name.lexeme());
+    }
+    if (dynamic_cast<This *>(expr)) {
+        return resolveLocal(current, "this");
+    }
+    return -1;
+}
+
+int RegisterCompiler::variable(std::string_view name)
+{
+    if (int reg = resolveLocal(current, name); reg != -1) {
+        return reg;
+    }
+    int reg = allocate();
+    if (int index = resolveUpvalue(current, name); index != -1) {
+        emit(Instruction::abc(RegisterOp::GetUpvalue, reg, index));
+    } else {
+        emit(Instruction::abx(RegisterOp::GetGlobal, reg, identifierConstant(name)));
+    }
+    return reg;
+}
+
+Chunk &RegisterCompiler::chunk()
+{
+    return current->prototype->chunk;
+}
+
+void RegisterCompiler::emit(Instruction instruction)
+{
+    chunk().write(instruction, line);
+}
+
+void RegisterCompiler::emitExtra(std::string_view name)
+{
+    emit(Instruction::extra(identifierConstant(name), 0));
+}
+
+void RegisterCompiler::emitCache(std::uint16_t name)
+{
+    std::size_t cache = chunk().addCache();
+    if (cache >= MaxCaches) {
+        error("Too many property accesses and calls in one chunk");
+        return;
+    }
+    emit(Instruction::extra(name, static_cast<std::uint16_t>(cache)));
+}
+
+std::size_t RegisterCompiler::emitJump(RegisterOp op, int reg)
+{
+    emit(Instruction::asbx(op, reg, 0));
+    return chunk().instructions.size() - 1;
+}
+
+void RegisterCompiler::patchJump(std::size_t jump)
+{
+    std::size_t offset = chunk().instructions.size() - jump - 1;
+    if (offset > static_cast<std::size_t>(Instruction::MaxSBx)) {
+        error("Too much code to jump over");
+    }
+    Instruction &instruction = chunk().instructions.at(jump);
+    instruction = Instruction::asbx(instruction.op(), instruction.a(), static_cast<std::int32_t>(offset));
+}
+
+void RegisterCompiler::emitLoop(std::size_t loopStart)
+{
+    // +1 to also jump back over the Jump itself
+    std::size_t offset = chunk().instructions.size() - loopStart + 1;
+    if (offset > static_cast<std::size_t>(Instruction::MaxSBx)) {
+        error("Loop body too large");
+    }
+    emit(Instruction::asbx(RegisterOp::Jump, 0, -static_cast<std::int32_t>(offset)));
+}
+
+void RegisterCompiler::emitReturn()
+{
+    if (current->type == FunctionType::Initializer) {
+        emit(Instruction::abc(RegisterOp::Return, 0));
+        return;
+    }
+    int reg = allocate();
+    emit(Instruction::abc(RegisterOp::Nil, reg));
+    emit(Instruction::abc(RegisterOp::Return, reg));
+}
+
+std::uint16_t RegisterCompiler::makeConstant(const object::Value &value)
+{
+    std::size_t constant = chunk().addConstant(value);
+    if (constant >= MaxConstants) {
+        error("Too many constants in one chunk");
+        return 0;
+    }
+    return static_cast<std::uint16_t>(constant);
+}
+
+std::uint16_t RegisterCompiler::identifierConstant(std::string_view name)
+{
+    return makeConstant(object::intern(name));
+}
+
+void RegisterCompiler::beginScope()
+{
+    current->scopeDepth++;
+}
+
+void RegisterCompiler::endScope()
+{
+    current->scopeDepth--;
+
+    auto &locals = current->locals;
+    int closeFrom = -1;
+    while (!locals.empty() and locals.back().depth > current->scopeDepth) {
+        if (locals.back().isCaptured) {
+            closeFrom = locals.back().reg;
+        }
+        current->freeRegister = locals.back().reg;
+        locals.pop_back();
+    }
+    if (closeFrom != -1) {
+        emit(Instruction::abc(RegisterOp::Close, closeFrom));
+    }
+}
+
+void RegisterCompiler::addLocal(std::string_view name, int reg)
+{
+    current->locals.push_back(Local{name, reg, current->scopeDepth});
+}
+
+int RegisterCompiler::resolveLocal(FunctionState *state, std::string_view name)
+{
+    for (auto it = state->locals.rbegin(); it != state->locals.rend(); ++it) {
+        if (it->name == name) {
+            return it->reg;
+        }
+    }
+    return -1;
+}
+
+int RegisterCompiler::resolveUpvalue(FunctionState *state, std::string_view name)
+{
+    if (!state->enclosing) {
+        return -1;
+    }
+
+    auto &locals = state->enclosing->locals;
+    for (auto it = locals.rbegin(); it != locals.rend(); ++it) {
+        if (it->name == name) {
+            it->isCaptured = true;
+            return addUpvalue(state, static_cast<std::uint8_t>(it->reg), true);
+        }
+    }
+
+    if (int upvalue = resolveUpvalue(state->enclosing, name); upvalue != -1) {
+        return addUpvalue(state, static_cast<std::uint8_t>(upvalue), false);
+    }
+    return -1;
+}
+
+int RegisterCompiler::addUpvalue(FunctionState *state, std::uint8_t index, bool isLocal)
+{
+    auto &upvalues = state->upvalues;
+    for (std::size_t i = 0; i < upvalues.size(); ++i) {
+        if (upvalues.at(i).index == index and upvalues.at(i).isLocal == isLocal) {
+            return i;
+        }
+    }
+
+    if (upvalues.size() >= MaxUpvalues) {
+        error("Too many closure variables in function");
+        return 0;
+    }
+    upvalues.push_back(Upvalue{index, isLocal});
+    return upvalues.size() - 1;
+}
+
+void RegisterCompiler::error(const std::string &message)
+{
+    Driver::error(line, message);
+}
+
+}  // namespace draft
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ast.h"
+#include "chunk.h"
+#include "heap.h"
+#include "obj_closure.h"
+
+namespace draft {
+
+// Turns a resolved syntax tree into three-address code for the RegisterVM. Locals live in
+// registers at the bottom of the frame, temporaries are allocated above them and released as soon
+// as the expression that needed them is done, so every statement starts with no temporaries
+class RegisterCompiler : public IExprVisitor<object::Value>, IStmtVisitor<void>, object::RootSet {
+public:
+    RegisterCompiler();
+    ~RegisterCompiler() override;
+
+    object::PrototypePtr compile(const std::vector<Stmt *> &statements);
+
+    // The prototypes being compiled are not reachable from anywhere else yet
+    void markRoots(object::Heap &heap) override;
+
+private:
+    enum class FunctionType { Script, Function, Initializer, Method };
+
+    struct Local {
+        std::string_view name;
+        int reg = 0;
+        int depth = 0;
+        bool isCaptured = false;
+    };
+
+    struct Upvalue {
+        std::uint8_t index = 0;
+        bool isLocal = false;
+    };
+
+    // Compilation state of a single function, chained to the function it is nested in
+    struct FunctionState {
+        FunctionState *enclosing = nullptr;
+        object::PrototypePtr prototype = nullptr;
+        FunctionType type = FunctionType::Script;
+        std::vector<Local> locals;
+        std::vector<Upvalue> upvalues;
+        int scopeDepth = 0;
+        int freeRegister = 0;  // lowest register not holding a local or a live temporary
+    };
+
+    // Expressions leave their value in the register target
+    object::Value visit(Literal *expr) override;
+    object::Value visit(Logical *expr) override;
+    object::Value visit(Unary *expr) override;
+    object::Value visit(Binary *expr) override;
+    object::Value visit(Call *expr) override;
+    object::Value visit(Grouping *expr) override;
+    object::Value visit(Variable *expr) override;
+    object::Value visit(Assign *expr) override;
+    object::Value visit(Get *expr) override;
+    object::Value visit(Set *expr) override;
+    object::Value visit(Super *expr) override;
+    object::Value visit(This *expr) override;
+
+    void visit(ExprStmt *stmt) override;
+    void visit(If *stmt) override;
+    void visit(FuncStmt *stmt) override;
+    void visit(Print *stmt) override;
+    void visit(Return *stmt) override;
+    void visit(While *stmt) override;
+    void visit(Block *stmt) override;
+    void visit(Class *stmt) override;
+    void visit(Var *stmt) override;
+
+    void compile(Stmt *stmt);
+    // Evaluates expr into register reg, temporaries it needs are released afterwards
+    void compile(Expr *expr, int reg);
+    // Evaluates expr into some register and returns it: a local is used in place, anything else
+    // goes to a new temporary
+    int compileAny(Expr *expr);
+    // Like compileAny(), but also returns constants as RK operands. A local is copied if later,
+    // evaluated after expr, might assign it
+    int compileOperand(Expr *expr, Expr *later = nullptr);
+    void function(FuncStmt *stmt, FunctionType type, int reg);
+
+    int allocate();
+    void releaseTemporaries();
+    // Register of a local variable or "this" expression, -1 for anything else
+    int localRegister(Expr *expr);
+    // Register holding the variable name: its own for a local, else a temporary it is loaded into
+    int variable(std::string_view name);
+
+    Chunk &chunk();
+    void emit(Instruction instruction);
+    void emitExtra(std::string_view name);
+    void emitCache(std::uint16_t name = 0);
+    std::size_t emitJump(RegisterOp op, int reg = 0);
+    void patchJump(std::size_t jump);
+    void emitLoop(std::size_t loopStart);
+    void emitReturn();
+    std::uint16_t makeConstant(const object::Value &value);
+    std::uint16_t identifierConstant(std::string_view name);
+
+    void beginScope();
+    void endScope();
+    void addLocal(std::string_view name, int reg);
+    int resolveLocal(FunctionState *state, std::string_view name);
+    int resolveUpvalue(FunctionState *state, std::string_view name);
+    int addUpvalue(FunctionState *state, std::uint8_t index, bool isLocal);
+
+    void error(const std::string &message);
+
+    FunctionState *current = nullptr;
+    int target = 0;        // register the expression being visited leaves its value in
+    std::size_t line = 1;  // line of the most recent token seen, literals carry none
+};
+
+}  // namespace draft
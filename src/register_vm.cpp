@@ -0,0 +1,565 @@
+#include "register_vm.h"
+
+#include <algorithm>
+
+#include "builtin.h"
+#include "driver.h"
+#include "heap.h"
+#include "obj_class.h"
+#include "obj_instance.h"
+
+namespace draft {
+
+#ifdef DRAFT_DISPATCH_STATS
+#define COUNT_DISPATCH() ++Driver::dispatched
+#else
+#define COUNT_DISPATCH() (void)0
+#endif
+
+RegisterVM::RegisterVM()
+    : stack(InitialStack)
+    , frames(64)
+{
+    resetStack();
+    object::heap().addRoots(this);
+    object::Roots roots;
+    auto *clock = object::make<ClockFunction>();
+    roots.add(clock);
+    globals.emplace(object::intern("clock"), clock);
+}
+
+RegisterVM::~RegisterVM()
+{
+    object::heap().removeRoots(this);
+}
+
+void RegisterVM::markRoots(object::Heap &heap)
+{
+    if (frameCount > 0) {
+        for (object::Value *slot = stack.data(); slot < frames[frameCount - 1].top; ++slot) {
+            heap.mark(*slot);
+        }
+    }
+    for (std::size_t i = 0; i < frameCount; ++i) {
+        heap.mark(frames[i].closure);
+    }
+    for (object::Upvalue *upvalue = openUpvalues; upvalue; upvalue = upvalue->next) {
+        heap.mark(upvalue);
+    }
+    for (const auto &[name, value] : globals) {
+        heap.mark(name);
+        heap.mark(value);
+    }
+}
+
+RegisterVM::Result RegisterVM::interpret(object::PrototypePtr script)
+{
+    auto closure = object::make<object::Closure>(script);
+    stack[0] = closure;
+    call(closure, stack.data(), 0);
+    return run();
+}
+
+RegisterVM::Result RegisterVM::run()
+{
+    CallFrame *frame = &frames[frameCount - 1];
+    // Copies of the running frame's state, which lives in registers while the frame runs.
+    // frame->ip is only brought up to date when something else reads it: calls and runtime errors
+    const Instruction *ip = frame->ip;
+    object::Value *slots = frame->slots;
+    const object::Value *constants = frame->closure->prototype->chunk.constants.data();
+
+    auto loadFrame = [&]() {
+        frame = &frames[frameCount - 1];
+        ip = frame->ip;
+        slots = frame->slots;
+        constants = frame->closure->prototype->chunk.constants.data();
+    };
+    auto rk = [&slots, &constants](std::uint32_t operand) -> const object::Value & {
+        return operand < Instruction::ConstantBit ? slots[operand] : constants[operand - Instruction::ConstantBit];
+    };
+    auto readCache = [&frame](Instruction extra) -> object::InlineCache & {
+        return frame->closure->prototype->chunk.caches[extra.cache()];
+    };
+    auto fail = [this, &frame, &ip](const std::string &message) {
+        frame->ip = ip;
+        runtimeError(message);
+        return Result::RuntimeError;
+    };
+
+#define BINARY_OP(op)                                                      \
+    do {                                                                   \
+        const object::Value &b = rk(instruction.b());                      \
+        const object::Value &c = rk(instruction.c());                      \
+        if (!b.isNumber() or !c.isNumber()) {                              \
+            return fail("Operands must be numbers");                       \
+        }                                                                  \
+        slots[instruction.a()] = b.asNumber() op c.asNumber();             \
+    } while (false)
+
+    // Same scheme as VM::run(), see there
+    Instruction instruction = *ip++;
+#ifdef DRAFT_COMPUTED_GOTO
+    static const void *const dispatchTable[] = {
+#define REGISTER_OP(name) &&op_##name,
+#include "register_op.def"
+    };
+#define CASE(name) op_##name
+#define DISPATCH()                                                       \
+    do {                                                                 \
+        COUNT_DISPATCH();                                                \
+        goto *dispatchTable[static_cast<std::size_t>(instruction.op())]; \
+    } while (false)
+#define NEXT()               \
+    do {                     \
+        instruction = *ip++; \
+        DISPATCH();          \
+    } while (false)
+    DISPATCH();
+#else
+#define CASE(name) case RegisterOp::name
+#define NEXT()               \
+    instruction = *ip++; \
+    continue
+    while (true)
+        switch (COUNT_DISPATCH(), instruction.op())
+#endif
+    {
+    CASE(Move):
+        slots[instruction.a()] = slots[instruction.b()];
+        NEXT();
+    CASE(Constant):
+        slots[instruction.a()] = constants[instruction.bx()];
+        NEXT();
+    CASE(Nil):
+        slots[instruction.a()] = object::Null{};
+        NEXT();
+    CASE(Boolean):
+        slots[instruction.a()] = instruction.b() != 0;
+        NEXT();
+    CASE(GetGlobal): {
+        object::String *name = constants[instruction.bx()].asString();
+        auto it = globals.find(name);
+        if (it == globals.end()) {
+            return fail("Undefined variable '" + name->chars + "'");
+        }
+        slots[instruction.a()] = it->second;
+        NEXT();
+    }
+    CASE(DefineGlobal):
+        globals.insert_or_assign(constants[instruction.bx()].asString(), slots[instruction.a()]);
+        NEXT();
+    CASE(SetGlobal): {
+        object::String *name = constants[instruction.bx()].asString();
+        auto it = globals.find(name);
+        if (it == globals.end()) {
+            return fail("Undefined variable '" + name->chars + "'");
+        }
+        it->second = slots[instruction.a()];
+        NEXT();
+    }
+    CASE(GetUpvalue):
+        slots[instruction.a()] = *frame->closure->upvalues[instruction.b()]->location;
+        NEXT();
+    CASE(SetUpvalue):
+        *frame->closure->upvalues[instruction.b()]->location = slots[instruction.a()];
+        NEXT();
+    CASE(GetProperty): {
+        Instruction extra = *ip++;
+        const object::Value &object = slots[instruction.b()];
+        if (!object.isInstance()) {
+            return fail("Only instances have properties");
+        }
+        object::String *name = constants[extra.name()].asString();
+        slots[instruction.a()] = object.asInstance()->getProperty(name, readCache(extra));
+        NEXT();
+    }
+    CASE(SetProperty): {
+        Instruction extra = *ip++;
+        const object::Value &object = slots[instruction.a()];
+        if (!object.isInstance()) {
+            return fail("Only instances have fields");
+        }
+        object::String *name = constants[extra.name()].asString();
+        object.asInstance()->setProperty(name, slots[instruction.b()], readCache(extra));
+        NEXT();
+    }
+    CASE(GetSuper): {
+        Instruction extra = *ip++;
+        object::String *name = constants[extra.name()].asString();
+        auto *superclass = static_cast<object::Class *>(slots[instruction.c()].asCallable());
+        auto method = superclass->findMethod(name);
+        if (!method) {
+            return fail("Undefined property '" + name->chars + "'");
+        }
+        slots[instruction.a()] = method->bind(slots[instruction.b()].asInstance());
+        NEXT();
+    }
+    CASE(Equal):
+        slots[instruction.a()] = object::isEqual(rk(instruction.b()), rk(instruction.c()));
+        NEXT();
+    CASE(NotEqual):
+        slots[instruction.a()] = !object::isEqual(rk(instruction.b()), rk(instruction.c()));
+        NEXT();
+    CASE(Greater):
+        BINARY_OP(>);
+        NEXT();
+    CASE(GreaterEqual):
+        BINARY_OP(>=);
+        NEXT();
+    CASE(Less):
+        BINARY_OP(<);
+        NEXT();
+    CASE(LessEqual):
+        BINARY_OP(<=);
+        NEXT();
+    CASE(Add): {
+        const object::Value &b = rk(instruction.b());
+        const object::Value &c = rk(instruction.c());
+        if (b.isNumber() and c.isNumber()) {
+            slots[instruction.a()] = b.asNumber() + c.asNumber();
+        } else if (b.isString() and c.isString()) {
+            slots[instruction.a()] = object::intern(b.asString()->chars + c.asString()->chars);
+        } else {
+            return fail("Operands must be two numbers or two strings");
+        }
+        NEXT();
+    }
+    CASE(Subtract):
+        BINARY_OP(-);
+        NEXT();
+    CASE(Multiply):
+        BINARY_OP(*);
+        NEXT();
+    CASE(Divide):
+        BINARY_OP(/);
+        NEXT();
+    CASE(Not):
+        slots[instruction.a()] = !object::isTruthy(slots[instruction.b()]);
+        NEXT();
+    CASE(Negate): {
+        const object::Value &operand = slots[instruction.b()];
+        if (!operand.isNumber()) {
+            return fail("Operand must be a number");
+        }
+        slots[instruction.a()] = -operand.asNumber();
+        NEXT();
+    }
+    CASE(Print):
+        io::writeLine(object::obj2str(slots[instruction.a()]));
+        NEXT();
+    CASE(Jump):
+        ip += instruction.sbx();
+        NEXT();
+    CASE(JumpIfFalse):
+        if (!object::isTruthy(slots[instruction.a()])) {
+            ip += instruction.sbx();
+        }
+        NEXT();
+    CASE(JumpIfTrue):
+        if (object::isTruthy(slots[instruction.a()])) {
+            ip += instruction.sbx();
+        }
+        NEXT();
+    CASE(Call): {
+        object::InlineCache &cache = readCache(*ip++);
+        frame->ip = ip;
+        if (!callValue(slots + instruction.a(), instruction.b(), cache)) {
+            return Result::RuntimeError;
+        }
+        loadFrame();
+        NEXT();
+    }
+    CASE(TailCall): {
+        object::InlineCache &cache = readCache(*ip++);
+        frame->ip = ip;
+        object::Value *callee = slots + instruction.a();
+        std::size_t argCount = instruction.b();
+        object::Closure *closure = tailCallee(*callee, argCount);
+        bool called = closure ? tailCall(closure, callee, argCount) : callValue(callee, argCount, cache);
+        if (!called) {
+            return Result::RuntimeError;
+        }
+        loadFrame();
+        NEXT();
+    }
+    CASE(Invoke): {
+        Instruction extra = *ip++;
+        object::InlineCache &callCache = readCache(*ip++);
+        frame->ip = ip;
+        object::String *name = constants[extra.name()].asString();
+        if (!invoke(slots + instruction.a(), name, instruction.b(), readCache(extra), callCache)) {
+            return Result::RuntimeError;
+        }
+        loadFrame();
+        NEXT();
+    }
+    CASE(TailInvoke): {
+        Instruction extra = *ip++;
+        object::InlineCache &cache = readCache(extra);
+        object::InlineCache &callCache = readCache(*ip++);
+        frame->ip = ip;
+        object::String *name = constants[extra.name()].asString();
+        object::Value *receiver = slots + instruction.a();
+        std::size_t argCount = instruction.b();
+        // The receiver already is where the method expects it
+        object::Closure *method = nullptr;
+        if (receiver->isInstance()) {
+            method = static_cast<object::Closure *>(receiver->asInstance()->getMethod(name, cache));
+        }
+        bool called = method and method->arity() == argCount ? tailCall(method, receiver, argCount)
+                                                             : invoke(receiver, name, argCount, cache, callCache);
+        if (!called) {
+            return Result::RuntimeError;
+        }
+        loadFrame();
+        NEXT();
+    }
+    CASE(Closure): {
+        object::Prototype *prototype = frame->closure->prototype->chunk.prototypes[instruction.bx()];
+        auto *closure = object::make<object::Closure>(prototype);
+        // In a register before capturing, which allocates
+        slots[instruction.a()] = closure;
+        for (auto &upvalue : closure->upvalues) {
+            Instruction capture = *ip++;
+            upvalue = capture.a() ? captureUpvalue(slots + capture.b()) : frame->closure->upvalues[capture.b()];
+        }
+        NEXT();
+    }
+    CASE(Close):
+        closeUpvalues(slots + instruction.a());
+        NEXT();
+    CASE(Return): {
+        object::Value result = slots[instruction.a()];
+        closeUpvalues(slots);
+        // The result replaces the callee in the caller's registers
+        slots[0] = result;
+        frameCount--;
+        if (frameCount == 0) {
+            slots[0] = object::Null{};
+            return Result::Ok;
+        }
+        loadFrame();
+        NEXT();
+    }
+    CASE(Class):
+        slots[instruction.a()] = object::make<object::Class>(constants[instruction.bx()].asString()->chars, nullptr,
+                                                             object::SymbolMap<object::MethodPtr>{});
+        NEXT();
+    CASE(Inherit): {
+        const object::Value &superclass = slots[instruction.b()];
+        if (!superclass.isCallable() or superclass.asObj()->kind != object::Obj::Kind::Class) {
+            return fail("Superclass must be a class");
+        }
+        auto *subclass = static_cast<object::Class *>(slots[instruction.a()].asCallable());
+        subclass->superclass = static_cast<object::Class *>(superclass.asCallable());
+        NEXT();
+    }
+    CASE(Method): {
+        Instruction extra = *ip++;
+        auto *klass = static_cast<object::Class *>(slots[instruction.a()].asCallable());
+        klass->methods.insert_or_assign(constants[extra.name()].asString(),
+                                        static_cast<object::Closure *>(slots[instruction.b()].asCallable()));
+        NEXT();
+    }
+    }
+#undef NEXT
+#undef DISPATCH
+#undef CASE
+#undef BINARY_OP
+}
+
+void RegisterVM::resetStack()
+{
+    // Closures made before a runtime error keep their variables, later runs reuse the registers
+    closeUpvalues(stack.data());
+    frameCount = 0;
+}
+
+bool RegisterVM::callValue(object::Value *base, std::size_t argCount, object::InlineCache &cache)
+{
+    if (!base->isCallable()) {
+        runtimeError("Can only call functions and classes");
+        return false;
+    }
+    object::Callable *callable = base->asCallable();
+
+    switch (callable->kind) {
+    case object::Obj::Kind::Closure:
+        return call(static_cast<object::Closure *>(callable), base, argCount);
+    case object::Obj::Kind::BoundMethod: {
+        // The receiver takes the place of the bound method, which may release it
+        auto *bound = static_cast<object::BoundMethod *>(callable);
+        object::Closure *method = bound->method;
+        *base = bound->receiver;
+        return call(method, base, argCount);
+    }
+    case object::Obj::Kind::Class: {
+        auto *klass = static_cast<object::Class *>(callable);
+        // Also creates the root shape the instance starts from
+        auto initializer = klass->initializer(cache);
+        *base = object::make<object::Instance>(klass);
+        if (initializer) {
+            return call(static_cast<object::Closure *>(initializer), base, argCount);
+        }
+        if (argCount != 0) {
+            runtimeError("Expected 0 arguments but got " + std::to_string(argCount));
+            return false;
+        }
+        return true;
+    }
+    default:
+        break;
+    }
+
+    if (argCount != callable->arity()) {
+        runtimeError("Expected " + std::to_string(callable->arity()) + " arguments but got " +
+                     std::to_string(argCount));
+        return false;
+    }
+    *base = callable->call(nullptr, object::Arguments{base + 1, argCount});
+    return true;
+}
+
+bool RegisterVM::call(object::Closure *closure, object::Value *base, std::size_t argCount)
+{
+    if (argCount != closure->arity()) {
+        runtimeError("Expected " + std::to_string(closure->arity()) + " arguments but got " +
+                     std::to_string(argCount));
+        return false;
+    }
+    if (frameCount == maxDepth) {
+        runtimeError("Stack overflow");
+        return false;
+    }
+    std::size_t offset = base - stack.data();
+    if (offset + closure->prototype->registerCount > stack.size()) {
+        if (!growStack(offset + closure->prototype->registerCount)) {
+            return false;
+        }
+        base = stack.data() + offset;
+    }
+    if (frameCount == frames.size()) {
+        frames.resize(std::min(frames.size() * 2, maxDepth));
+    }
+    object::Value *top = base + closure->prototype->registerCount;
+
+    // Registers past the arguments may hold anything a previous frame left behind
+    std::fill(base + 1 + argCount, top, object::Value{});
+    CallFrame &frame = frames[frameCount++];
+    frame.closure = closure;
+    frame.ip = closure->prototype->chunk.instructions.data();
+    frame.slots = base;
+    frame.top = frameCount > 1 ? std::max(top, frames[frameCount - 2].top) : top;
+    return true;
+}
+
+bool RegisterVM::growStack(std::size_t size)
+{
+    if (size > StackMax) {
+        runtimeError("Stack overflow");
+        return false;
+    }
+    object::Value *previous = stack.data();
+    stack.resize(std::min(std::max(size, stack.size() * 2), StackMax));
+    auto moved = [this, previous](object::Value *slot) { return stack.data() + (slot - previous); };
+
+    for (std::size_t i = 0; i < frameCount; ++i) {
+        frames[i].slots = moved(frames[i].slots);
+        frames[i].top = moved(frames[i].top);
+    }
+    for (object::Upvalue *upvalue = openUpvalues; upvalue; upvalue = upvalue->next) {
+        upvalue->location = moved(upvalue->location);
+    }
+    return true;
+}
+
+bool RegisterVM::tailCall(object::Closure *closure, object::Value *base, std::size_t argCount)
+{
+    // The callee and its arguments move down to the running function's window, which returns
+    // whatever the callee does
+    object::Value *slots = frames[frameCount - 1].slots;
+    closeUpvalues(slots);
+    std::move(base, base + argCount + 1, slots);
+    frameCount--;
+    return call(closure, slots, argCount);
+}
+
+bool RegisterVM::invoke(object::Value *base, object::String *name, std::size_t argCount,
+                        object::InlineCache &cache, object::InlineCache &callCache)
+{
+    if (!base->isInstance()) {
+        runtimeError("Only instances have properties");
+        return false;
+    }
+    object::Instance *instance = base->asInstance();
+    if (object::MethodPtr method = instance->getMethod(name, cache)) {
+        return call(static_cast<object::Closure *>(method), base, argCount);
+    }
+    // A field is called like any other value
+    *base = instance->getProperty(name, cache);
+    return callValue(base, argCount, callCache);
+}
+
+object::Closure *RegisterVM::tailCallee(object::Value &callee, std::size_t argCount)
+{
+    if (!callee.isCallable()) {
+        return nullptr;
+    }
+    object::Callable *callable = callee.asCallable();
+    if (callable->kind == object::Obj::Kind::Closure) {
+        auto *closure = static_cast<object::Closure *>(callable);
+        return closure->arity() == argCount ? closure : nullptr;
+    }
+    if (callable->kind == object::Obj::Kind::BoundMethod) {
+        auto *bound = static_cast<object::BoundMethod *>(callable);
+        if (bound->method->arity() != argCount) {
+            return nullptr;
+        }
+        object::Closure *method = bound->method;
+        callee = bound->receiver;
+        return method;
+    }
+    return nullptr;
+}
+
+object::UpvaluePtr RegisterVM::captureUpvalue(object::Value *local)
+{
+    object::UpvaluePtr prev = nullptr;
+    object::UpvaluePtr upvalue = openUpvalues;
+    while (upvalue and upvalue->location > local) {
+        prev = upvalue;
+        upvalue = upvalue->next;
+    }
+    if (upvalue and upvalue->location == local) {
+        return upvalue;
+    }
+
+    auto *created = object::make<object::Upvalue>(local);
+    created->next = upvalue;
+    if (prev) {
+        prev->next = created;
+    } else {
+        openUpvalues = created;
+    }
+    return created;
+}
+
+void RegisterVM::closeUpvalues(object::Value *last)
+{
+    while (openUpvalues and openUpvalues->location >= last) {
+        openUpvalues->close();
+        openUpvalues = openUpvalues->next;
+    }
+}
+
+void RegisterVM::runtimeError(const std::string &message)
+{
+    const CallFrame &frame = frames[frameCount - 1];
+    const Chunk &chunk = frame.closure->prototype->chunk;
+    std::size_t offset = frame.ip - chunk.instructions.data() - 1;
+    Driver::runtimeError(chunk.lineAt(offset), message);
+    resetStack();
+}
+
+}  // namespace draft
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "heap.h"
+#include "obj_closure.h"
+
+namespace draft {
+
+// Register-based virtual machine running the code produced by the RegisterCompiler. Every frame
+// is a window of registers on a shared value stack; a call's window starts at the callee's
+// register in the caller, so arguments are passed without copying
+class RegisterVM : object::RootSet {
+public:
+    enum class Result { Ok, RuntimeError };
+
+    RegisterVM();
+    ~RegisterVM() override;
+
+    static constexpr std::size_t DefaultMaxDepth = 100'000;
+
+    Result interpret(object::PrototypePtr script);
+
+    void markRoots(object::Heap &heap) override;
+
+    // Calls nested deeper than this are reported as a stack overflow
+    std::size_t maxDepth = DefaultMaxDepth;
+
+private:
+    struct CallFrame {
+        object::Closure *closure = nullptr;
+        const Instruction *ip = nullptr;
+        object::Value *slots = nullptr;
+        // End of the registers of this frame and all below it, everything under it is a root
+        object::Value *top = nullptr;
+    };
+
+    // The registers start out few and grow as calls need them, up to StackMax values
+    static constexpr std::size_t InitialStack = 16 * 1024;
+    static constexpr std::size_t StackMax = 16 * 1024 * 1024;
+
+    Result run();
+
+    void resetStack();
+
+    bool callValue(object::Value *base, std::size_t argCount, object::InlineCache &cache);
+    bool call(object::Closure *closure, object::Value *base, std::size_t argCount);
+    // Runs closure in place of the running function, the callee and arguments start at base
+    bool tailCall(object::Closure *closure, object::Value *base, std::size_t argCount);
+    // Closure a tail call can hand the running frame over to, null if the callee is to be called
+    // as usual. A bound method's receiver takes its place
+    object::Closure *tailCallee(object::Value &callee, std::size_t argCount);
+    // Calls the method name on the receiver at base, without binding it. A field of that name is
+    // called like any other value
+    bool invoke(object::Value *base, object::String *name, std::size_t argCount, object::InlineCache &cache,
+                object::InlineCache &callCache);
+    // Makes room for size registers, moving them if they have to grow. Frames and open upvalues
+    // move along with them, any other pointer into the registers is left dangling
+    bool growStack(std::size_t size);
+    object::UpvaluePtr captureUpvalue(object::Value *local);
+    void closeUpvalues(object::Value *last);
+
+    void runtimeError(const std::string &message);
+
+    std::vector<object::Value> stack;
+    // Only the first frameCount are in use, the vector grows as calls nest deeper
+    std::vector<CallFrame> frames;
+    std::size_t frameCount = 0;
+
+    object::SymbolMap<object::Value> globals;
+    object::UpvaluePtr openUpvalues = nullptr;
+};
+
+}  // namespace draft
@@ -1,40 +1,37 @@
 #include "resolver.h"
 
+#include <algorithm>
+
 #include "driver.h"
 
 namespace draft {
-Resolver::Resolver(Interpreter *interpreter)
-    : interpreter{interpreter}
-{
-}
-
-object::Object Resolver::visit(Literal *)
+object::Value Resolver::visit(Literal *)
 {
     // there is no work to do
     return object::Null{};
 }
 
-object::Object Resolver::visit(Logical *expr)
+object::Value Resolver::visit(Logical *expr)
 {
     resolve(expr->left);
     resolve(expr->right);
     return object::Null{};
 }
 
-object::Object Resolver::visit(Unary *expr)
+object::Value Resolver::visit(Unary *expr)
 {
     resolve(expr->right);
     return object::Null{};
 }
 
-object::Object Resolver::visit(Binary *expr)
+object::Value Resolver::visit(Binary *expr)
 {
     resolve(expr->left);
     resolve(expr->right);
     return object::Null{};
 }
 
-object::Object Resolver::visit(Call *expr)
+object::Value Resolver::visit(Call *expr)
 {
     resolve(expr->callee);
     for (Expr *arg : expr->arguments) {
@@ -43,64 +40,65 @@ object::Object Resolver::visit(Call *expr)
     return object::Null{};
 }
 
-object::Object Resolver::visit(Grouping *expr)
+object::Value Resolver::visit(Grouping *expr)
 {
     resolve(expr->expression);
     return object::Null{};
 }
 
-object::Object Resolver::visit(Variable *expr)
+object::Value Resolver::visit(Variable *expr)
 {
     if (!scopes.empty()) {
-        auto &scope = scopes.back();
-        if (auto it = scope.find(expr->name.lexeme); it != scope.end()) {
-            if (!it->second) {
+        auto &scope = scopes.back().bindings;
+        if (auto it = scope.find(expr->name.lexeme()); it != scope.end()) {
+            if (!it->second.defined) {
                 Driver::error(expr->name.line, "Can't read local variable in its own initializer");
             }
         }
     }
-    resolveLocal(expr, expr->name);
+    resolveLocal(expr->location, expr->name.lexeme());
     return object::Null{};
 }
 
-object::Object Resolver::visit(Assign *expr)
+object::Value Resolver::visit(Assign *expr)
 {
     resolve(expr->value);
-    resolveLocal(expr, expr->name);
+    resolveLocal(expr->location, expr->name.lexeme());
     return object::Null{};
 }
 
-object::Object Resolver::visit(Get *expr)
+object::Value Resolver::visit(Get *expr)
 {
     resolve(expr->object);
     return object::Null{};
 }
 
-object::Object Resolver::visit(Set *expr)
+object::Value Resolver::visit(Set *expr)
 {
     resolve(expr->value);
     resolve(expr->object);
     return object::Null{};
 }
 
-object::Object Resolver::visit(Super *expr)
+object::Value Resolver::visit(Super *expr)
 {
     if (currentClass == ClassType::None) {
         Driver::error(expr->keyword.line, "Can't use 'super' outside a class");
     } else if (currentClass != ClassType::Subclass) {
         Driver::error(expr->keyword.line, "Can't use 'super' in a class with no superclass");
     }
-    resolveLocal(expr, expr->keyword);
+    resolveLocal(expr->location, "super");
+    resolveLocal(expr->thisLocation, "this");
     return object::Null{};
 }
 
-object::Object Resolver::visit(This *expr)
+object::Value Resolver::visit(This *expr)
 {
     if (currentClass == ClassType::None) {
         Driver::error(expr->keyword.line, "Can't use 'this' outside of a class");
         return object::Null{};
     }
-    resolveLocal(expr, expr->keyword);
+    resolveLocal(expr->location, "this");
     return object::Null{};
 }
 
@@ -120,9 +118,9 @@ void Resolver::visit(If *stmt)
 
 void Resolver::visit(FuncStmt *stmt)
 {
-    declare(stmt->name);
+    declare(stmt->name, &stmt->captured);
     define(stmt->name);
-    resolveFunction(stmt);
+    resolveFunction(stmt, FunctionType::Function);
 }
 
 void Resolver::visit(Print *stmt)
@@ -140,6 +138,15 @@ void Resolver::visit(Return *stmt)
             Driver::error(stmt->keyword.line, "Can't return a value from an initializer");
         }
         resolve(stmt->value);
+
+        // Whatever a call returns here is returned as is, the caller's frame is not needed anymore
+        Expr *value = stmt->value;
+        while (value->kind == Expr::Kind::Grouping) {
+            value = static_cast<Grouping *>(value)->expression;
+        }
+        if (value->kind == Expr::Kind::Call and currentFunction != FunctionType::None) {
+            static_cast<Call *>(value)->tail = true;
+        }
     }
 }
 
@@ -161,33 +168,28 @@ void Resolver::visit(Class *stmt)
     ClassType enclosingClass = currentClass;
     currentClass = ClassType::Class;
 
-    declare(stmt->name);
+    declare(stmt->name, &stmt->captured);
     define(stmt->name);
     if (stmt->superclass) {
-        if (stmt->name.lexeme == stmt->superclass->name.lexeme) {
+        if (stmt->name.lexeme() == stmt->superclass->name.lexeme()) {
             Driver::error(stmt->superclass->name.line, "A class can't inherit from itself");
         } else {
             currentClass = ClassType::Subclass;
             resolve(stmt->superclass);
         }
 
+        // The interpreter always keeps "super" in a cell, only methods refer to it
         beginScope();
-        scopes.back()["super"] = true;
+        bind("super");
     }
-    beginScope();
-    auto back = scopes.back();
-    back["this"] = true;
-    scopes.pop_back();
-    scopes.emplace_back(back);
 
     for (FuncStmt *method : stmt->methods) {
         FunctionType declaration = FunctionType::Method;
-        if (method->name.lexeme == "init") {
+        if (method->name.lexeme() == "init") {
             declaration = FunctionType::Initializer;
         }
         resolveFunction(method, declaration);
     }
-    endScope();
     if (stmt->superclass) {
         endScope();
     }
@@ -196,7 +198,7 @@ void Resolver::visit(Class *stmt)
 
 void Resolver::visit(Var *stmt)
 {
-    declare(stmt->name);
+    declare(stmt->name, &stmt->captured);
     if (stmt->initializer) {
         resolve(stmt->initializer);
     }
@@ -223,24 +225,37 @@ void Resolver::resolve(Expr *expr)
 void Resolver::beginScope()
 {
     Scope scope;
+    // A function's own scope starts a new frame
+    bool startsFrame = !functions.empty() and functions.back().scope == scopes.size();
+    if (!scopes.empty() and !startsFrame) {
+        scope.base = scopes.back().base + static_cast<int>(scopes.back().bindings.size());
+    }
     scopes.emplace_back(std::move(scope));
 }
 
 void Resolver::endScope()
 {
+    for (auto &[name, binding] : scopes.back().bindings) {
+        if (binding.captured) {
+            for (Location *use : binding.uses) {
+                use->kind = Location::Kind::Cell;
+            }
+        }
+    }
     scopes.pop_back();
 }
 
-void Resolver::declare(Token name)
+void Resolver::declare(Token name, bool *captured)
 {
     if (scopes.empty()) {
         return;
     }
     auto &scope = scopes.back();
-    if (scope.contains(name.lexeme)) {
+    if (scope.bindings.contains(name.lexeme())) {
         Driver::error(name.line, "Already a variable with this name in this scope");
     }
-    scope.emplace(name.lexeme, false);
+    int slot = scope.base + static_cast<int>(scope.bindings.size());
+    scope.bindings.emplace(name.lexeme(), Binding{slot, false, false, captured, {}});
 }
 
 void Resolver::define(Token name)
@@ -248,30 +263,85 @@ void Resolver::define(Token name)
     if (scopes.empty()) {
         return;
     }
-    scopes.back()[name.lexeme] = true;
+    scopes.back().bindings.at(name.lexeme()).defined = true;
 }
 
-void Resolver::resolveLocal(Expr *expr, Token name)
+// Declares and defines a name the interpreter binds by itself
+void Resolver::bind(std::string_view name)
 {
-    for (int i = scopes.size() - 1; i >= 0; i--) {
-        if (scopes.at(i).contains(name.lexeme)) {
-            interpreter->resolve(expr, scopes.size() - 1 - i);
+    auto &scope = scopes.back();
+    int slot = scope.base + static_cast<int>(scope.bindings.size());
+    scope.bindings.emplace(name, Binding{slot, true, false, nullptr, {}});
+}
+
+void Resolver::resolveLocal(Location &location, std::string_view name)
+{
+    for (std::size_t i = scopes.size(); i-- > 0;) {
+        auto it = scopes[i].bindings.find(name);
+        if (it == scopes[i].bindings.end()) {
+            continue;
+        }
+        Binding &binding = it->second;
+        if (functions.empty() or i >= functions.back().scope) {
+            location = Location{Location::Kind::Local, binding.slot};
+            binding.uses.push_back(&location);
             return;
         }
+        binding.captured = true;
+        if (binding.declaration) {
+            *binding.declaration = true;
+        }
+        location = Location{Location::Kind::Upvalue, resolveUpvalue(functions.size() - 1, i, binding.slot)};
+        return;
     }
+    location = Location{};
+}
+
+// Threads the variable in slot of the given scope through the closures of every function between
+// its declaration and the given one, returning its upvalue index in the latter
+int Resolver::resolveUpvalue(std::size_t function, std::size_t scope, int slot)
+{
+    FuncStmt *declaration = functions[function].declaration;
+    Capture capture;
+    if (function == 0 or scope >= functions[function - 1].scope) {
+        capture = Capture{true, slot};
+    } else {
+        capture = Capture{false, resolveUpvalue(function - 1, scope, slot)};
+    }
+
+    auto &captures = declaration->captures;
+    if (auto it = std::find(captures.begin(), captures.end(), capture); it != captures.end()) {
+        return static_cast<int>(it - captures.begin());
+    }
+    captures.push_back(capture);
+    return static_cast<int>(captures.size() - 1);
 }
 
 void Resolver::resolveFunction(FuncStmt *function, FunctionType type)
 {
     FunctionType enclosing = currentFunction;
     currentFunction = type;
+    functions.push_back(Function{function, scopes.size()});
     beginScope();
+    // Methods find their receiver in the first slot
+    if (type == FunctionType::Method or type == FunctionType::Initializer) {
+        bind("this");
+    }
     for (Token param : function->params) {
-        declare(param);
+        declare(param, nullptr);
         define(param);
     }
     resolve(function->body);
+
+    // Parameters are defined by the call itself, which boxes those that are captured
+    for (const auto &[name, binding] : scopes.back().bindings) {
+        if (binding.captured and !binding.declaration) {
+            function->cellSlots.push_back(binding.slot);
+        }
+    }
+    std::sort(function->cellSlots.begin(), function->cellSlots.end());
     endScope();
+    functions.pop_back();
     currentFunction = enclosing;
 }
 
@@ -1,35 +1,33 @@
 #pragma once
 
 #include <map>
-#include <stack>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "ast.h"
 
 namespace draft {
-class Interpreter;
-
-class Resolver : public IExprVisitor<object::Object>, IStmtVisitor<void> {
+class Resolver : public IExprVisitor<object::Value>, IStmtVisitor<void> {
 public:
     enum class FunctionType { None, Function, Initializer, Method };
     enum class ClassType { None, Class, Subclass };
 
-    explicit Resolver(Interpreter *interpreter);
-
     void resolve(const std::vector<Stmt *> &statements);
 
 private:
-    object::Object visit(Literal *expr) override;
-    object::Object visit(Logical *expr) override;
-    object::Object visit(Unary *expr) override;
-    object::Object visit(Binary *expr) override;
-    object::Object visit(Call *expr) override;
-    object::Object visit(Grouping *expr) override;
-    object::Object visit(Variable *expr) override;
-    object::Object visit(Assign *expr) override;
-    object::Object visit(Get *expr) override;
-    object::Object visit(Set *expr) override;
-    object::Object visit(Super *expr) override;
-    object::Object visit(This *expr) override;
+    object::Value visit(Literal *expr) override;
+    object::Value visit(Logical *expr) override;
+    object::Value visit(Unary *expr) override;
+    object::Value visit(Binary *expr) override;
+    object::Value visit(Call *expr) override;
+    object::Value visit(Grouping *expr) override;
+    object::Value visit(Variable *expr) override;
+    object::Value visit(Assign *expr) override;
+    object::Value visit(Get *expr) override;
+    object::Value visit(Set *expr) override;
+    object::Value visit(Super *expr) override;
+    object::Value visit(This *expr) override;
 
     void visit(ExprStmt *stmt) override;
     void visit(If *stmt) override;
@@ -46,16 +44,36 @@ private:
 
     void beginScope();
     void endScope();
-    void declare(Token name);
+    void declare(Token name, bool *captured);
     void define(Token name);
-    void resolveLocal(Expr *expr, Token name);
+    void bind(std::string_view name);
+    void resolveLocal(Location &location, std::string_view name);
+    int resolveUpvalue(std::size_t function, std::size_t scope, int slot);
     void resolveFunction(FuncStmt *function, FunctionType type = FunctionType::None);
 
-    Interpreter *interpreter = nullptr;
-
-    using Scope = std::map<std::string, bool>;
+    // A local gets the next free slot of its function's frame when it is declared
+    struct Binding {
+        int slot;
+        bool defined;
+        bool captured = false;
+        // Flag of the declaring statement, told when a closure captures the variable
+        bool *declaration = nullptr;
+        // Accesses from the declaring function, which go through the cell once it is captured
+        std::vector<Location *> uses;
+    };
+    struct Scope {
+        std::map<std::string_view, Binding> bindings;
+        int base = 0;  // first slot of the scope, the scopes around it in the same frame come before
+    };
     std::vector<Scope> scopes;
     FunctionType currentFunction = FunctionType::None;
+
+    // Functions being resolved, innermost last. The top-level code is not among them
+    struct Function {
+        FuncStmt *declaration;
+        std::size_t scope;  // index of the function's own scope
+    };
+    std::vector<Function> functions;
     ClassType currentClass = ClassType::None;
 };
 
@@ -0,0 +1,112 @@
+#include "scan.h"
+
+#include "scan_simd.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace draft::scan {
+namespace {
+
+constexpr Scanner scalarScanner{"scalar", scalar::blank, scalar::lineEnd, scalar::stringEnd, scalar::identifierEnd};
+
+#ifdef __SSE2__
+// Part of every x86-64 processor
+struct Sse2 {
+    using Vector = __m128i;
+    static constexpr const char *Name = "sse2";
+    static constexpr std::size_t Width = 16;
+
+    static Vector load(const char *bytes)
+    {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes));
+    }
+    static Vector splat(char c)
+    {
+        return _mm_set1_epi8(c);
+    }
+    static Vector add(Vector a, Vector b)
+    {
+        return _mm_add_epi8(a, b);
+    }
+    static Vector bitwiseOr(Vector a, Vector b)
+    {
+        return _mm_or_si128(a, b);
+    }
+    static Vector equal(Vector a, Vector b)
+    {
+        return _mm_cmpeq_epi8(a, b);
+    }
+    static Vector less(Vector a, Vector b)
+    {
+        return _mm_cmplt_epi8(a, b);
+    }
+    static std::uint32_t mask(Vector v)
+    {
+        return static_cast<std::uint32_t>(_mm_movemask_epi8(v));
+    }
+};
+#endif
+
+}  // namespace
+
+#ifdef DRAFT_SCAN_AVX2
+// In scan_avx2.cpp, the only file with AVX2 instructions
+extern const Scanner avx2Scanner;
+#endif
+
+namespace {
+
+const Scanner *available(std::string_view name)
+{
+    if (name == "scalar") {
+        return &scalarScanner;
+    }
+#ifdef __SSE2__
+    if (name == "sse2") {
+        return &Vectorized<Sse2>::scanner;
+    }
+#endif
+#ifdef DRAFT_SCAN_AVX2
+    if (name == "avx2" and __builtin_cpu_supports("avx2")) {
+        return &avx2Scanner;
+    }
+#endif
+    return nullptr;
+}
+
+const Scanner *widest()
+{
+    // Runs before main, possibly before the runtime has looked at the processor by itself
+#ifdef DRAFT_SCAN_AVX2
+    __builtin_cpu_init();
+#endif
+    for (std::string_view name : {"avx2", "sse2"}) {
+        if (const Scanner *scanner = available(name)) {
+            return scanner;
+        }
+    }
+    return &scalarScanner;
+}
+
+const Scanner *chosen = widest();
+
+}  // namespace
+
+const Scanner &scanner()
+{
+    return *chosen;
+}
+
+bool choose(std::string_view name)
+{
+    const Scanner *scanner = available(name);
+    if (!scanner) {
+        return false;
+    }
+    chosen = scanner;
+    return true;
+}
+
+}  // namespace draft::scan
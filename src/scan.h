@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace draft::scan {
+
+// Loops of the Lexer that run over many bytes at once. Each starts at from and returns the position
+// of the first byte that ends the run, or the size of the text if none does. The ones that may
+// cross lines add the newlines they passed to lines
+struct Scanner {
+    const char *name;
+    // Past spaces, tabs, carriage returns and newlines
+    std::size_t (*blank)(std::string_view text, std::size_t from, std::size_t &lines);
+    // To the newline ending a comment
+    std::size_t (*lineEnd)(std::string_view text, std::size_t from);
+    // To the closing quote of a string
+    std::size_t (*stringEnd)(std::string_view text, std::size_t from, char quote, std::size_t &lines);
+    // Past letters, digits and underscores
+    std::size_t (*identifierEnd)(std::string_view text, std::size_t from);
+};
+
+// The widest implementation the processor supports, unless another one was chosen
+const Scanner &scanner();
+// Chooses the implementation called name: scalar, sse2 or avx2. False if it is unknown or the
+// processor lacks it
+bool choose(std::string_view name);
+
+}  // namespace draft::scan
@@ -0,0 +1,51 @@
+// The only code using AVX2 instructions, only called once the processor is known to support it
+
+#include <immintrin.h>
+
+#define DRAFT_SCAN_TARGET __attribute__((target("avx2")))
+#include "scan_simd.h"
+
+namespace draft::scan {
+namespace {
+
+struct Avx2 {
+    using Vector = __m256i;
+    static constexpr const char *Name = "avx2";
+    static constexpr std::size_t Width = 32;
+
+    DRAFT_SCAN_TARGET static Vector load(const char *bytes)
+    {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes));
+    }
+    DRAFT_SCAN_TARGET static Vector splat(char c)
+    {
+        return _mm256_set1_epi8(c);
+    }
+    DRAFT_SCAN_TARGET static Vector add(Vector a, Vector b)
+    {
+        return _mm256_add_epi8(a, b);
+    }
+    DRAFT_SCAN_TARGET static Vector bitwiseOr(Vector a, Vector b)
+    {
+        return _mm256_or_si256(a, b);
+    }
+    DRAFT_SCAN_TARGET static Vector equal(Vector a, Vector b)
+    {
+        return _mm256_cmpeq_epi8(a, b);
+    }
+    DRAFT_SCAN_TARGET static Vector less(Vector a, Vector b)
+    {
+        return _mm256_cmpgt_epi8(b, a);
+    }
+    DRAFT_SCAN_TARGET static std::uint32_t mask(Vector v)
+    {
+        return static_cast<std::uint32_t>(_mm256_movemask_epi8(v));
+    }
+};
+
+}  // namespace
+
+extern const Scanner avx2Scanner;
+const Scanner avx2Scanner = Vectorized<Avx2>::scanner;
+
+}  // namespace draft::scan
@@ -0,0 +1,155 @@
+#pragma once
+
+// Implementations of the scanners in scan.h, only included by their translation units. Everything
+// has internal linkage, each file gets copies of its own
+
+#include <bit>
+#include <cstdint>
+
+#include "scan.h"
+
+// Instruction set the vectorized scanners are built for, which the includer may name with a target
+// attribute. Only their own functions get it: inline functions of the standard library they call
+// are shared with the other files, so those must be built for every processor
+#ifndef DRAFT_SCAN_TARGET
+#define DRAFT_SCAN_TARGET
+#endif
+
+namespace draft::scan {
+namespace {
+
+constexpr bool isBlank(char c)
+{
+    return c == ' ' or c == '\t' or c == '\r' or c == '\n';
+}
+
+constexpr bool isIdentifier(char c)
+{
+    return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or (c >= '0' and c <= '9') or c == '_';
+}
+
+// One byte at a time, for processors without vectors and for the last bytes of the text
+namespace scalar {
+
+std::size_t blank(std::string_view text, std::size_t from, std::size_t &lines)
+{
+    for (; from < text.size() and isBlank(text[from]); from++) {
+        lines += text[from] == '\n';
+    }
+    return from;
+}
+
+std::size_t lineEnd(std::string_view text, std::size_t from)
+{
+    while (from < text.size() and text[from] != '\n') {
+        from++;
+    }
+    return from;
+}
+
+std::size_t stringEnd(std::string_view text, std::size_t from, char quote, std::size_t &lines)
+{
+    for (; from < text.size() and text[from] != quote; from++) {
+        lines += text[from] == '\n';
+    }
+    return from;
+}
+
+std::size_t identifierEnd(std::string_view text, std::size_t from)
+{
+    while (from < text.size() and isIdentifier(text[from])) {
+        from++;
+    }
+    return from;
+}
+
+}  // namespace scalar
+
+// Scanners over vectors of V::Width bytes. V wraps the intrinsics of an instruction set: loads,
+// byte comparisons and a mask with a bit per byte. Each scanner finds the bytes that end its run
+// in a whole vector at once, and leaves what does not fill one to the scalar scanners
+template <typename V>
+struct Vectorized {
+    using Vector = typename V::Vector;
+    using Mask = std::uint32_t;
+
+    static constexpr Mask All = V::Width == 32 ? ~Mask{0} : (Mask{1} << V::Width) - 1;
+
+    DRAFT_SCAN_TARGET static Mask matches(Vector bytes, char c)
+    {
+        return V::mask(V::equal(bytes, V::splat(c)));
+    }
+
+    // Bytes from first to last, comparing signed after shifting first to the lowest value
+    DRAFT_SCAN_TARGET static Mask inRange(Vector bytes, char first, char last)
+    {
+        Vector shifted = V::add(bytes, V::splat(static_cast<char>(-128 - first)));
+        return V::mask(V::less(shifted, V::splat(static_cast<char>(-128 + (last - first) + 1))));
+    }
+
+    DRAFT_SCAN_TARGET static Mask below(Mask mask, int n)
+    {
+        return mask & ((Mask{1} << n) - 1);
+    }
+
+    DRAFT_SCAN_TARGET static std::size_t blank(std::string_view text, std::size_t from, std::size_t &lines)
+    {
+        for (; from + V::Width <= text.size(); from += V::Width) {
+            Vector bytes = V::load(text.data() + from);
+            Mask newlines = matches(bytes, '\n');
+            Mask stop = ~(newlines | matches(bytes, ' ') | matches(bytes, '\t') | matches(bytes, '\r')) & All;
+            if (stop) {
+                int n = std::countr_zero(stop);
+                lines += std::popcount(below(newlines, n));
+                return from + n;
+            }
+            lines += std::popcount(newlines);
+        }
+        return scalar::blank(text, from, lines);
+    }
+
+    DRAFT_SCAN_TARGET static std::size_t lineEnd(std::string_view text, std::size_t from)
+    {
+        for (; from + V::Width <= text.size(); from += V::Width) {
+            if (Mask stop = matches(V::load(text.data() + from), '\n')) {
+                return from + std::countr_zero(stop);
+            }
+        }
+        return scalar::lineEnd(text, from);
+    }
+
+    DRAFT_SCAN_TARGET static std::size_t stringEnd(std::string_view text, std::size_t from, char quote,
+                                                   std::size_t &lines)
+    {
+        for (; from + V::Width <= text.size(); from += V::Width) {
+            Vector bytes = V::load(text.data() + from);
+            Mask newlines = matches(bytes, '\n');
+            if (Mask stop = matches(bytes, quote)) {
+                int n = std::countr_zero(stop);
+                lines += std::popcount(below(newlines, n));
+                return from + n;
+            }
+            lines += std::popcount(newlines);
+        }
+        return scalar::stringEnd(text, from, quote, lines);
+    }
+
+    DRAFT_SCAN_TARGET static std::size_t identifierEnd(std::string_view text, std::size_t from)
+    {
+        for (; from + V::Width <= text.size(); from += V::Width) {
+            Vector bytes = V::load(text.data() + from);
+            // Setting bit 5 turns upper case letters into lower case ones
+            Mask letters = inRange(V::bitwiseOr(bytes, V::splat(0x20)), 'a', 'z');
+            Mask stop = ~(letters | inRange(bytes, '0', '9') | matches(bytes, '_')) & All;
+            if (stop) {
+                return from + std::countr_zero(stop);
+            }
+        }
+        return scalar::identifierEnd(text, from);
+    }
+
+    static constexpr Scanner scanner{V::Name, blank, lineEnd, stringEnd, identifierEnd};
+};
+
+}  // namespace
+}  // namespace draft::scan
@@ -1,39 +1,135 @@
 #include "source.h"
 
-#include <codecvt>
-#include <locale>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "scan.h"
 
 namespace draft {
 
-std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t> conv;
+namespace {
+
+constexpr Source::Char Replacement = U'\uFFFD';
+
+bool isContinuation(char byte)
+{
+    return (static_cast<unsigned char>(byte) & 0xc0) == 0x80;
+}
+
+}  // namespace
+
+Source::Source(std::string_view utf8)
+    : size{utf8.size()}
+{
+    auto copy = std::make_unique_for_overwrite<char[]>(size);
+    std::memcpy(copy.get(), utf8.data(), size);
+    bytes = Bytes{copy.release(), Release{0}};
+    calculateLineOffsets();
+}
 
-Source::Source(const std::string &utf8)
-    : buf{fromStdString(utf8)}
+Source::Source(Bytes bytes, std::size_t size)
+    : bytes{std::move(bytes)}
+    , size{size}
 {
     calculateLineOffsets();
 }
 
+std::optional<Source> Source::load(const std::string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return std::nullopt;
+    }
+    struct ::stat info {};
+    if (::fstat(fd, &info) == -1) {
+        ::close(fd);
+        return std::nullopt;
+    }
+
+    // Empty files cannot be mapped, pipes and the like have no size to map
+    bool regular = S_ISREG(info.st_mode);
+    if (regular and info.st_size > 0) {
+        auto mappedSize = static_cast<std::size_t>(info.st_size);
+        void *mapping = ::mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            ::close(fd);
+            // The lexer goes through it once from start to end
+            ::madvise(mapping, mappedSize, MADV_SEQUENTIAL);
+            return Source{Bytes{static_cast<const char *>(mapping), Release{mappedSize}}, mappedSize};
+        }
+    }
+
+    // Read into a single allocation as large as the file, grown only for files without a size. Some
+    // regular files report none either, like the ones in /proc
+    std::size_t capacity = regular ? static_cast<std::size_t>(info.st_size) : 0;
+    auto buffer = std::make_unique_for_overwrite<char[]>(capacity);
+    std::size_t length = 0;
+    while (true) {
+        if (length == capacity and regular and capacity > 0) {
+            break;
+        }
+        if (length == capacity) {
+            std::size_t larger = std::max<std::size_t>(capacity * 2, 4096);
+            auto grown = std::make_unique_for_overwrite<char[]>(larger);
+            std::memcpy(grown.get(), buffer.get(), length);
+            buffer = std::move(grown);
+            capacity = larger;
+        }
+        ::ssize_t count = ::read(fd, buffer.get() + length, capacity - length);
+        if (count == -1 and errno == EINTR) {
+            continue;
+        }
+        if (count == -1) {
+            ::close(fd);
+            return std::nullopt;
+        }
+        if (count == 0) {
+            break;
+        }
+        length += static_cast<std::size_t>(count);
+    }
+    ::close(fd);
+    return Source{Bytes{buffer.release(), Release{0}}, length};
+}
+
+void Source::Release::operator()(const char *bytes) const
+{
+    if (mapped) {
+        ::munmap(const_cast<char *>(bytes), mapped);
+    } else {
+        delete[] bytes;
+    }
+}
+
 Source::Position Source::positionAt(Offset offset) const
 {
     Position pos{};
 
-    if (buf.empty()) {
+    if (size == 0) {
         return pos;
     }
 
-    offset = std::min(offset, buf.size() - 1);
+    offset = std::min(offset, size - 1);
 
     auto it = std::upper_bound(lineOffsets.begin(), lineOffsets.end(), offset);
     auto index = std::distance(lineOffsets.begin(), std::prev(it));
 
     pos.line = index + 1;
-    pos.column = offset - lineOffsets.at(index) + 1;
+    // Every code point has exactly one byte that is not a continuation byte
+    const char *begin = bytes.get() + lineOffsets.at(index);
+    pos.column = std::count_if(begin, bytes.get() + offset, [](char byte) { return !isContinuation(byte); }) + 1;
     return pos;
 }
 
-std::string Source::lineAt(std::uint32_t line) const
+std::string_view Source::lineAt(std::uint32_t line) const
 {
-    if (buf.empty()) {
+    if (size == 0) {
         return "";
     }
 
@@ -43,41 +139,46 @@ std::string Source::lineAt(std::uint32_t line) const
     }
 
     auto begin = lineOffsets.at(line);
-    auto end = line == lineOffsets.size() - 1 ? buf.size() : lineOffsets.at(line + 1);
-    Buffer utf32 = buf.substr(begin, end - begin);
-    return toStdString(utf32);
+    auto end = line == lineOffsets.size() - 1 ? size : lineOffsets.at(line + 1);
+    return text().substr(begin, end - begin);
 }
 
 Source::Char Source::charAt(Offset offset) const
 {
-    if (offset < buf.size()) {
-        return buf.at(offset);
+    if (offset >= size) {
+        return '\0';
     }
-    return '\0';
-}
 
-std::string Source::toStdString(const std::u32string &utf32)
-{
-    return conv.to_bytes(utf32);
-}
+    auto lead = static_cast<unsigned char>(bytes.get()[offset]);
+    std::size_t length = lead < 0x80 ? 1 : lead >> 5 == 0x6 ? 2 : lead >> 4 == 0xe ? 3 : lead >> 3 == 0x1e ? 4 : 0;
+    if (length == 0 or offset + length > size) {
+        return Replacement;
+    }
+    if (length == 1) {
+        return lead;
+    }
 
-std::u32string Source::fromStdString(const std::string &utf8)
-{
-    return conv.from_bytes(utf8);
+    Char c = lead & (0x7f >> length);
+    for (std::size_t i = 1; i < length; ++i) {
+        if (!isContinuation(bytes.get()[offset + i])) {
+            return Replacement;
+        }
+        c = c << 6 | (static_cast<unsigned char>(bytes.get()[offset + i]) & 0x3f);
+    }
+    return c;
 }
 
+// Finds the newlines with the lexer's vectorized scanner
 void Source::calculateLineOffsets()
 {
     lineOffsets.clear();
-    bool isLineStart = true;
-    for (Offset i = 0; i < buf.size(); ++i) {
-        if (isLineStart) {
-            lineOffsets.push_back(i);
-        }
-        isLineStart = buf.at(i) == '\n';
+    if (size == 0) {
+        return;
     }
-    if (isLineStart and buf.size() != 0) {
-        lineOffsets.push_back(buf.size());
+    const scan::Scanner &scanner = scan::scanner();
+    lineOffsets.push_back(0);
+    for (Offset newline = scanner.lineEnd(text(), 0); newline < size; newline = scanner.lineEnd(text(), newline + 1)) {
+        lineOffsets.push_back(newline + 1);
     }
 }
 }  // namespace draft
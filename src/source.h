@@ -1,14 +1,20 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace draft {
 
+// A source file as the UTF-8 bytes it was read as. Offsets count bytes, columns count code points
+// and are only worked out when a diagnostic asks for a position. Files are mapped into memory where
+// possible, the lexer and diagnostics look at the mapping itself
 class Source {
 public:
     using Id = std::uint64_t;
-    using Buffer = std::u32string;
     using Char = char32_t;
 
     using Offset = std::size_t;
@@ -23,19 +29,36 @@ public:
     };
 
     Source() = default;
-    explicit Source(const std::string &utf8);
+    // Copies utf8, for sources that are not files
+    explicit Source(std::string_view utf8);
+
+    // Maps the file at path, or reads it when it cannot be mapped. Empty if it cannot be read
+    static std::optional<Source> load(const std::string &path);
+
+    std::string_view text() const
+    {
+        return {bytes.get(), size};
+    }
 
     Position positionAt(Offset offset) const;
-    std::string lineAt(std::uint32_t line) const;
+    std::string_view lineAt(std::uint32_t line) const;
+    // The code point starting at offset, or U+FFFD if the bytes there do not start one
     Char charAt(Offset offset) const;
 
-    static std::string toStdString(const std::u32string &utf32);
-    static std::u32string fromStdString(const std::string &utf8);
-
 private:
+    // Unmaps the bytes of a mapped file, deletes the others
+    struct Release {
+        std::size_t mapped;  // size of the mapping, zero if there is none
+        void operator()(const char *bytes) const;
+    };
+    using Bytes = std::unique_ptr<const char, Release>;
+
+    Source(Bytes bytes, std::size_t size);
+
     void calculateLineOffsets();
 
-    Buffer buf;
+    Bytes bytes;
+    std::size_t size = 0;
     std::vector<Offset> lineOffsets;
 };
 
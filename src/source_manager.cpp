@@ -2,12 +2,18 @@
 
 namespace draft {
 
-Source::Id SourceManager::makeSource(const std::string &source, const std::string &path)
+Source::Id SourceManager::makeSource(std::string_view source, const std::string &path)
 {
-    Source::Id id = sources.size();
-    paths.emplace_back(path);
-    sources.emplace_back(source);
-    return id;
+    return add(Source{source}, path);
+}
+
+std::optional<Source::Id> SourceManager::loadFile(const std::string &path)
+{
+    std::optional<Source> source = Source::load(path);
+    if (!source) {
+        return std::nullopt;
+    }
+    return add(std::move(*source), path);
 }
 
 const std::string &SourceManager::getPath(Source::Id id) const
@@ -20,4 +26,12 @@ const Source &SourceManager::getSource(Source::Id id) const
     return sources.at(id);
 }
 
+Source::Id SourceManager::add(Source source, const std::string &path)
+{
+    Source::Id id = sources.size();
+    paths.emplace_back(path);
+    sources.push_back(std::move(source));
+    return id;
+}
+
 }  // namespace draft
@@ -1,19 +1,26 @@
 #pragma once
 
+#include <optional>
 #include <vector>
 
 #include "source.h"
 
 namespace draft {
 
+// Owns the sources of a run. Their bytes stay where they are for as long as the manager lives, so
+// tokens and diagnostics can refer to them
 class SourceManager {
 public:
-    Source::Id makeSource(const std::string &source, const std::string &path = "");
+    Source::Id makeSource(std::string_view source, const std::string &path = "");
+    // Empty if the file cannot be read
+    std::optional<Source::Id> loadFile(const std::string &path);
 
     const std::string &getPath(Source::Id id) const;
     const Source &getSource(Source::Id id) const;
 
 private:
+    Source::Id add(Source source, const std::string &path);
+
     std::vector<std::string> paths;
     std::vector<Source> sources;
 };
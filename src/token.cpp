@@ -1,5 +1,9 @@
 #include "token.h"
 
+#include <algorithm>
+
+#include "heap.h"
+
 namespace draft {
 
 static std::string kind2str(Token::Kind kind)
@@ -17,17 +21,24 @@ static std::string kind2str(Token::Kind kind)
     return "Unrecognized";
 }
 
-Token::Token(Kind kind, Lexeme lexeme, object::Object literal, std::size_t line)
-    : kind{kind}
-    , lexeme{std::move(lexeme)}
-    , literal{std::move(literal)}
-    , line{line}
+Token::Token(Kind kind, std::string_view lexeme, std::size_t line)
+    : start{lexeme.data()}
+    , length{static_cast<std::uint32_t>(lexeme.size())}
+    , line{static_cast<std::uint32_t>(std::min(line, MaxLine))}
+    , kind{kind}
+{
+}
+
+std::string Token::toString() const
 {
+    return kind2str(kind) + " " + std::string{lexeme()};
 }
 
-std::string Token::toString()
+Name::Name(const Token &token)
+    : Token{token}
+    , interned{object::intern(token.lexeme())}
 {
-    return kind2str(kind) + " " + lexeme + " " + object::obj2str(literal);
+    object::heap().pin(interned);
 }
 
 }  // namespace draft
@@ -1,30 +1,62 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 
 #include "object.h"
 
 namespace draft {
 
-using Lexeme = std::string;
-
+// A token refers to its lexeme in the source, which has to outlive it. The Parser reads literals
+// from the lexeme, so scanning allocates nothing but the tokens themselves
 class Token {
 public:
-    enum class Kind {
+    enum class Kind : std::uint8_t {
         Unrecognized,
 #define TOKEN(kind) kind,
 #include "token.def"
         EndOfFile,
     };
 
-    Token(Kind kind, Lexeme lexeme, object::Object literal, std::size_t line);
+    // Lines past it are all reported as the last one
+    static constexpr std::size_t MaxLine = (std::size_t{1} << 24) - 1;
+
+    Token(Kind kind, std::string_view lexeme, std::size_t line);
+
+    std::string toString() const;
 
-    std::string toString();
+    std::string_view lexeme() const
+    {
+        return {start, length};
+    }
 
+private:
+    const char *start = nullptr;
+    std::uint32_t length = 0;
+
+public:
+    std::uint32_t line : 24;
     const Kind kind = Kind::Unrecognized;
-    Lexeme lexeme;
-    object::Object literal;
-    std::size_t line = 0;
+};
+
+static_assert(sizeof(Token) == 16);
+
+// An identifier, "this" or "super" in the syntax tree, along with the name the runtime looks it up
+// by. Interned names stay alive for good, the syntax tree refers to them for as long as the
+// program runs. The runtime reads names from the symbol only: in the REPL a function outlives the
+// source of the line it was declared on, the tree-walker only keeps its syntax tree
+class Name : public Token {
+public:
+    Name(const Token &token);
+
+    object::String *symbol() const
+    {
+        return interned;
+    }
+
+private:
+    object::String *interned = nullptr;
 };
 
 }  // namespace draft
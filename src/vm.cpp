@@ -0,0 +1,597 @@
+#include "vm.h"
+
+#include <algorithm>
+
+#include "builtin.h"
+#include "driver.h"
+#include "heap.h"
+#include "obj_class.h"
+#include "obj_instance.h"
+
+namespace draft {
+
+#ifdef DRAFT_DISPATCH_STATS
+#define COUNT_DISPATCH() ++Driver::dispatched
+#else
+#define COUNT_DISPATCH() (void)0
+#endif
+
+VM::VM()
+    : stack(InitialStack)
+    , frames(64)
+{
+    resetStack();
+    object::heap().addRoots(this);
+    object::Roots roots;
+    auto *clock = object::make<ClockFunction>();
+    roots.add(clock);
+    globals.emplace(object::intern("clock"), clock);
+}
+
+VM::~VM()
+{
+    object::heap().removeRoots(this);
+}
+
+void VM::markRoots(object::Heap &heap)
+{
+    for (object::Value *slot = stack.data(); slot < stackTop; ++slot) {
+        heap.mark(*slot);
+    }
+    for (std::size_t i = 0; i < frameCount; ++i) {
+        heap.mark(frames[i].closure);
+    }
+    for (object::Upvalue *upvalue = openUpvalues; upvalue; upvalue = upvalue->next) {
+        heap.mark(upvalue);
+    }
+    for (const auto &[name, value] : globals) {
+        heap.mark(name);
+        heap.mark(value);
+    }
+}
+
+VM::Result VM::interpret(object::PrototypePtr script)
+{
+    auto closure = object::make<object::Closure>(script);
+    push(closure);
+    call(closure, 0);
+    return run();
+}
+
+VM::Result VM::run()
+{
+    CallFrame *frame = &frames[frameCount - 1];
+    // Lives in a register while the frame runs, frame->ip is only brought up to date when something
+    // else reads it: calls and runtime errors
+    const std::uint8_t *ip = frame->ip;
+
+    auto readByte = [&ip]() { return *ip++; };
+    auto readShort = [&ip]() {
+        ip += 2;
+        return static_cast<std::uint16_t>(ip[-2] << 8 | ip[-1]);
+    };
+    auto readConstant = [&frame, &readShort]() -> const object::Value & {
+        return frame->closure->prototype->chunk.constants[readShort()];
+    };
+    auto readString = [&readConstant]() { return readConstant().asString(); };
+    auto readCache = [&frame, &readShort]() -> object::InlineCache & {
+        return frame->closure->prototype->chunk.caches[readShort()];
+    };
+    auto fail = [this, &frame, &ip](const std::string &message) {
+        frame->ip = ip;
+        runtimeError(message);
+        return Result::RuntimeError;
+    };
+
+#define BINARY_OP(op)                                               \
+    do {                                                            \
+        if (!peek(0).isNumber() or !peek(1).isNumber()) {           \
+            return fail("Operands must be numbers");                \
+        }                                                           \
+        object::Number b = pop().asNumber();                        \
+        object::Number a = peek(0).asNumber();                      \
+        peek(0) = a op b;                                           \
+    } while (false)
+
+    // Handlers are written once, as CASE(name) labels ending in NEXT(). With computed goto every
+    // handler jumps straight to the next one through a table built from opcode.def, otherwise they
+    // are the cases of a switch in a loop
+#ifdef DRAFT_COMPUTED_GOTO
+    static const void *const dispatchTable[] = {
+#define OPCODE(name) &&op_##name,
+#include "opcode.def"
+    };
+#define CASE(name) op_##name
+#define NEXT()                            \
+    do {                                  \
+        COUNT_DISPATCH();                 \
+        goto *dispatchTable[readByte()]; \
+    } while (false)
+    NEXT();
+#else
+#define CASE(name) case OpCode::name
+#define NEXT() continue
+    while (true)
+        switch (COUNT_DISPATCH(), static_cast<OpCode>(readByte()))
+#endif
+    {
+    CASE(Constant):
+        push(readConstant());
+        NEXT();
+    CASE(Nil):
+        push(object::Null{});
+        NEXT();
+    CASE(True):
+        push(true);
+        NEXT();
+    CASE(False):
+        push(false);
+        NEXT();
+    CASE(Pop):
+        pop();
+        NEXT();
+    CASE(GetLocal):
+        push(frame->slots[readByte()]);
+        NEXT();
+    CASE(SetLocal):
+        frame->slots[readByte()] = peek(0);
+        NEXT();
+    CASE(GetGlobal): {
+        object::String *name = readString();
+        auto it = globals.find(name);
+        if (it == globals.end()) {
+            return fail("Undefined variable '" + name->chars + "'");
+        }
+        push(it->second);
+        NEXT();
+    }
+    CASE(DefineGlobal):
+        globals.insert_or_assign(readString(), pop());
+        NEXT();
+    CASE(SetGlobal): {
+        object::String *name = readString();
+        auto it = globals.find(name);
+        if (it == globals.end()) {
+            return fail("Undefined variable '" + name->chars + "'");
+        }
+        it->second = peek(0);
+        NEXT();
+    }
+    CASE(GetUpvalue):
+        push(*frame->closure->upvalues[readByte()]->location);
+        NEXT();
+    CASE(SetUpvalue):
+        *frame->closure->upvalues[readByte()]->location = peek(0);
+        NEXT();
+    CASE(GetProperty): {
+        if (!peek(0).isInstance()) {
+            return fail("Only instances have properties");
+        }
+        object::String *name = readString();
+        peek(0) = peek(0).asInstance()->getProperty(name, readCache());
+        NEXT();
+    }
+    CASE(SetProperty): {
+        if (!peek(1).isInstance()) {
+            return fail("Only instances have fields");
+        }
+        object::String *name = readString();
+        peek(1).asInstance()->setProperty(name, peek(0), readCache());
+        object::Value value = pop();
+        peek(0) = std::move(value);
+        NEXT();
+    }
+    CASE(GetSuper): {
+        object::String *name = readString();
+        object::Value superclass = pop();
+        auto method = static_cast<object::Class *>(superclass.asCallable())->findMethod(name);
+        if (!method) {
+            return fail("Undefined property '" + name->chars + "'");
+        }
+        peek(0) = method->bind(peek(0).asInstance());
+        NEXT();
+    }
+    CASE(Equal): {
+        object::Value b = pop();
+        peek(0) = object::isEqual(peek(0), b);
+        NEXT();
+    }
+    CASE(NotEqual): {
+        object::Value b = pop();
+        peek(0) = !object::isEqual(peek(0), b);
+        NEXT();
+    }
+    CASE(Greater):
+        BINARY_OP(>);
+        NEXT();
+    CASE(GreaterEqual):
+        BINARY_OP(>=);
+        NEXT();
+    CASE(Less):
+        BINARY_OP(<);
+        NEXT();
+    CASE(LessEqual):
+        BINARY_OP(<=);
+        NEXT();
+    CASE(Add): {
+        if (peek(0).isNumber() and peek(1).isNumber()) {
+            object::Number b = pop().asNumber();
+            peek(0) = peek(0).asNumber() + b;
+        } else if (peek(0).isString() and peek(1).isString()) {
+            object::Value b = pop();
+            peek(0) = object::intern(peek(0).asString()->chars + b.asString()->chars);
+        } else {
+            return fail("Operands must be two numbers or two strings");
+        }
+        NEXT();
+    }
+    CASE(Subtract):
+        BINARY_OP(-);
+        NEXT();
+    CASE(Multiply):
+        BINARY_OP(*);
+        NEXT();
+    CASE(Divide):
+        BINARY_OP(/);
+        NEXT();
+    CASE(Not):
+        peek(0) = !object::isTruthy(peek(0));
+        NEXT();
+    CASE(Negate):
+        if (!peek(0).isNumber()) {
+            return fail("Operand must be a number");
+        }
+        peek(0) = -peek(0).asNumber();
+        NEXT();
+    CASE(Print):
+        io::writeLine(object::obj2str(pop()));
+        NEXT();
+    CASE(Jump): {
+        std::uint16_t offset = readShort();
+        ip += offset;
+        NEXT();
+    }
+    CASE(JumpIfFalse): {
+        std::uint16_t offset = readShort();
+        if (!object::isTruthy(peek(0))) {
+            ip += offset;
+        }
+        NEXT();
+    }
+    CASE(Loop): {
+        std::uint16_t offset = readShort();
+        ip -= offset;
+        NEXT();
+    }
+    CASE(Call): {
+        std::size_t argCount = readByte();
+        object::InlineCache &cache = readCache();
+        frame->ip = ip;
+        if (!callValue(peek(argCount), argCount, cache)) {
+            return Result::RuntimeError;
+        }
+        frame = &frames[frameCount - 1];
+        ip = frame->ip;
+        NEXT();
+    }
+    CASE(TailCall): {
+        std::size_t argCount = readByte();
+        object::InlineCache &cache = readCache();
+        frame->ip = ip;
+        object::Value &callee = peek(argCount);
+        object::Closure *closure = tailCallee(callee, argCount);
+        bool called = closure ? tailCall(closure, argCount) : callValue(callee, argCount, cache);
+        if (!called) {
+            return Result::RuntimeError;
+        }
+        frame = &frames[frameCount - 1];
+        ip = frame->ip;
+        NEXT();
+    }
+    CASE(Invoke): {
+        object::String *name = readString();
+        std::size_t argCount = readByte();
+        object::InlineCache &cache = readCache();
+        object::InlineCache &callCache = readCache();
+        frame->ip = ip;
+        if (!invoke(name, argCount, cache, callCache)) {
+            return Result::RuntimeError;
+        }
+        frame = &frames[frameCount - 1];
+        ip = frame->ip;
+        NEXT();
+    }
+    CASE(TailInvoke): {
+        object::String *name = readString();
+        std::size_t argCount = readByte();
+        object::InlineCache &cache = readCache();
+        object::InlineCache &callCache = readCache();
+        frame->ip = ip;
+        // The receiver already is where the method expects it
+        const object::Value &receiver = peek(argCount);
+        object::Closure *method = nullptr;
+        if (receiver.isInstance()) {
+            method = static_cast<object::Closure *>(receiver.asInstance()->getMethod(name, cache));
+        }
+        bool called = method and method->arity() == argCount ? tailCall(method, argCount)
+                                                             : invoke(name, argCount, cache, callCache);
+        if (!called) {
+            return Result::RuntimeError;
+        }
+        frame = &frames[frameCount - 1];
+        ip = frame->ip;
+        NEXT();
+    }
+    CASE(Closure): {
+        object::Prototype *prototype = frame->closure->prototype->chunk.prototypes[readShort()];
+        auto *closure = object::make<object::Closure>(prototype);
+        // On the stack before capturing, which allocates
+        push(closure);
+        for (auto &upvalue : closure->upvalues) {
+            std::uint8_t isLocal = readByte();
+            std::uint8_t index = readByte();
+            upvalue = isLocal ? captureUpvalue(frame->slots + index) : frame->closure->upvalues[index];
+        }
+        NEXT();
+    }
+    CASE(CloseUpvalue):
+        closeUpvalues(stackTop - 1);
+        pop();
+        NEXT();
+    CASE(Return): {
+        object::Value result = pop();
+        closeUpvalues(frame->slots);
+        frameCount--;
+        if (frameCount == 0) {
+            pop();
+            return Result::Ok;
+        }
+        while (stackTop > frame->slots) {
+            pop();
+        }
+        push(std::move(result));
+        frame = &frames[frameCount - 1];
+        ip = frame->ip;
+        NEXT();
+    }
+    CASE(Class):
+        push(object::make<object::Class>(readString()->chars, nullptr, object::SymbolMap<object::MethodPtr>{}));
+        NEXT();
+    CASE(Inherit): {
+        if (!peek(1).isCallable() or peek(1).asObj()->kind != object::Obj::Kind::Class) {
+            return fail("Superclass must be a class");
+        }
+        auto *subclass = static_cast<object::Class *>(peek(0).asCallable());
+        subclass->superclass = static_cast<object::Class *>(peek(1).asCallable());
+        pop();
+        NEXT();
+    }
+    CASE(Method): {
+        object::String *name = readString();
+        auto *klass = static_cast<object::Class *>(peek(1).asCallable());
+        klass->methods.insert_or_assign(name, static_cast<object::Closure *>(peek(0).asCallable()));
+        pop();
+        NEXT();
+    }
+    }
+#undef NEXT
+#undef CASE
+#undef BINARY_OP
+}
+
+void VM::push(object::Value value)
+{
+    *stackTop = std::move(value);
+    stackTop++;
+}
+
+object::Value VM::pop()
+{
+    stackTop--;
+    return std::move(*stackTop);
+}
+
+object::Value &VM::peek(std::size_t distance)
+{
+    return stackTop[-1 - static_cast<std::ptrdiff_t>(distance)];
+}
+
+void VM::resetStack()
+{
+    // Closures made before a runtime error keep their variables, later runs reuse the slots
+    closeUpvalues(stack.data());
+    while (stackTop > stack.data()) {
+        pop();
+    }
+    stackTop = stack.data();
+    frameCount = 0;
+}
+
+bool VM::callValue(const object::Value &callee, std::size_t argCount, object::InlineCache &cache)
+{
+    if (!callee.isCallable()) {
+        runtimeError("Can only call functions and classes");
+        return false;
+    }
+    object::Callable *callable = callee.asCallable();
+
+    switch (callable->kind) {
+    case object::Obj::Kind::Closure:
+        return call(static_cast<object::Closure *>(callable), argCount);
+    case object::Obj::Kind::BoundMethod: {
+        // The receiver takes the place of the bound method, which may release it
+        auto *bound = static_cast<object::BoundMethod *>(callable);
+        object::Closure *method = bound->method;
+        object::Value receiver = bound->receiver;
+        stackTop[-1 - static_cast<std::ptrdiff_t>(argCount)] = std::move(receiver);
+        return call(method, argCount);
+    }
+    case object::Obj::Kind::Class: {
+        auto *klass = static_cast<object::Class *>(callable);
+        // Also creates the root shape the instance starts from
+        auto initializer = klass->initializer(cache);
+        auto instance = object::make<object::Instance>(klass);
+        stackTop[-1 - static_cast<std::ptrdiff_t>(argCount)] = std::move(instance);
+        if (initializer) {
+            return call(static_cast<object::Closure *>(initializer), argCount);
+        }
+        if (argCount != 0) {
+            runtimeError("Expected 0 arguments but got " + std::to_string(argCount));
+            return false;
+        }
+        return true;
+    }
+    default:
+        break;
+    }
+
+    if (argCount != callable->arity()) {
+        runtimeError("Expected " + std::to_string(callable->arity()) + " arguments but got " +
+                     std::to_string(argCount));
+        return false;
+    }
+    object::Value result = callable->call(nullptr, object::Arguments{stackTop - argCount, argCount});
+    for (std::size_t i = 0; i < argCount + 1; ++i) {
+        pop();
+    }
+    push(std::move(result));
+    return true;
+}
+
+bool VM::call(object::Closure *closure, std::size_t argCount)
+{
+    if (argCount != closure->arity()) {
+        runtimeError("Expected " + std::to_string(closure->arity()) + " arguments but got " +
+                     std::to_string(argCount));
+        return false;
+    }
+    if (frameCount == maxDepth) {
+        runtimeError("Stack overflow");
+        return false;
+    }
+    std::size_t base = stackTop - stack.data() - argCount - 1;
+    std::size_t size = base + closure->prototype->stackSize;
+    if (size > stack.size() and !growStack(size)) {
+        return false;
+    }
+    if (frameCount == frames.size()) {
+        frames.resize(std::min(frames.size() * 2, maxDepth));
+    }
+
+    CallFrame &frame = frames[frameCount++];
+    frame.closure = closure;
+    frame.ip = closure->prototype->chunk.code.data();
+    frame.slots = stack.data() + base;
+    return true;
+}
+
+bool VM::growStack(std::size_t size)
+{
+    if (size > StackMax) {
+        runtimeError("Stack overflow");
+        return false;
+    }
+    object::Value *previous = stack.data();
+    stack.resize(std::min(std::max(size, stack.size() * 2), StackMax));
+    auto moved = [this, previous](object::Value *slot) { return stack.data() + (slot - previous); };
+
+    stackTop = moved(stackTop);
+    for (std::size_t i = 0; i < frameCount; ++i) {
+        frames[i].slots = moved(frames[i].slots);
+    }
+    for (object::Upvalue *upvalue = openUpvalues; upvalue; upvalue = upvalue->next) {
+        upvalue->location = moved(upvalue->location);
+    }
+    return true;
+}
+
+bool VM::tailCall(object::Closure *closure, std::size_t argCount)
+{
+    // The callee and its arguments replace the running function's, which returns whatever the
+    // callee does
+    object::Value *slots = frames[frameCount - 1].slots;
+    closeUpvalues(slots);
+    stackTop = std::move(stackTop - argCount - 1, stackTop, slots);
+    frameCount--;
+    return call(closure, argCount);
+}
+
+bool VM::invoke(object::String *name, std::size_t argCount, object::InlineCache &cache,
+                object::InlineCache &callCache)
+{
+    object::Value &receiver = peek(argCount);
+    if (!receiver.isInstance()) {
+        runtimeError("Only instances have properties");
+        return false;
+    }
+    object::Instance *instance = receiver.asInstance();
+    if (object::MethodPtr method = instance->getMethod(name, cache)) {
+        return call(static_cast<object::Closure *>(method), argCount);
+    }
+    // A field is called like any other value
+    receiver = instance->getProperty(name, cache);
+    return callValue(receiver, argCount, callCache);
+}
+
+object::Closure *VM::tailCallee(object::Value &callee, std::size_t argCount)
+{
+    if (!callee.isCallable()) {
+        return nullptr;
+    }
+    object::Callable *callable = callee.asCallable();
+    if (callable->kind == object::Obj::Kind::Closure) {
+        auto *closure = static_cast<object::Closure *>(callable);
+        return closure->arity() == argCount ? closure : nullptr;
+    }
+    if (callable->kind == object::Obj::Kind::BoundMethod) {
+        auto *bound = static_cast<object::BoundMethod *>(callable);
+        if (bound->method->arity() != argCount) {
+            return nullptr;
+        }
+        object::Closure *method = bound->method;
+        callee = bound->receiver;
+        return method;
+    }
+    return nullptr;
+}
+
+object::UpvaluePtr VM::captureUpvalue(object::Value *local)
+{
+    object::UpvaluePtr prev = nullptr;
+    object::UpvaluePtr upvalue = openUpvalues;
+    while (upvalue and upvalue->location > local) {
+        prev = upvalue;
+        upvalue = upvalue->next;
+    }
+    if (upvalue and upvalue->location == local) {
+        return upvalue;
+    }
+
+    auto *created = object::make<object::Upvalue>(local);
+    created->next = upvalue;
+    if (prev) {
+        prev->next = created;
+    } else {
+        openUpvalues = created;
+    }
+    return created;
+}
+
+void VM::closeUpvalues(object::Value *last)
+{
+    while (openUpvalues and openUpvalues->location >= last) {
+        openUpvalues->close();
+        openUpvalues = openUpvalues->next;
+    }
+}
+
+void VM::runtimeError(const std::string &message)
+{
+    const CallFrame &frame = frames[frameCount - 1];
+    const Chunk &chunk = frame.closure->prototype->chunk;
+    std::size_t offset = frame.ip - chunk.code.data() - 1;
+    Driver::runtimeError(chunk.lineAt(offset), message);
+    resetStack();
+}
+
+}  // namespace draft
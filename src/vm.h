@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "heap.h"
+#include "obj_closure.h"
+
+namespace draft {
+
+// Stack-based virtual machine running the bytecode produced by the Compiler
+class VM : object::RootSet {
+public:
+    enum class Result { Ok, RuntimeError };
+
+    VM();
+    ~VM() override;
+
+    static constexpr std::size_t DefaultMaxDepth = 100'000;
+
+    Result interpret(object::PrototypePtr script);
+
+    void markRoots(object::Heap &heap) override;
+
+    // Calls nested deeper than this are reported as a stack overflow
+    std::size_t maxDepth = DefaultMaxDepth;
+
+private:
+    struct CallFrame {
+        object::Closure *closure = nullptr;
+        const std::uint8_t *ip = nullptr;
+        object::Value *slots = nullptr;
+    };
+
+    // The stack starts out small and grows as calls need it, up to StackMax values
+    static constexpr std::size_t InitialStack = 16 * 1024;
+    static constexpr std::size_t StackMax = 16 * 1024 * 1024;
+
+    Result run();
+
+    void push(object::Value value);
+    object::Value pop();
+    object::Value &peek(std::size_t distance);
+    void resetStack();
+
+    bool callValue(const object::Value &callee, std::size_t argCount, object::InlineCache &cache);
+    bool call(object::Closure *closure, std::size_t argCount);
+    // Runs closure in place of the running function, the callee and arguments are on top of the stack
+    bool tailCall(object::Closure *closure, std::size_t argCount);
+    // Closure a tail call can hand the running frame over to, null if the callee is to be called
+    // as usual. A bound method's receiver takes its place
+    object::Closure *tailCallee(object::Value &callee, std::size_t argCount);
+    // Calls the method name on the receiver below the arguments, without binding it. A field of
+    // that name is called like any other value
+    bool invoke(object::String *name, std::size_t argCount, object::InlineCache &cache,
+                object::InlineCache &callCache);
+    // Makes room for size values on the stack, moving it if it has to grow. Frames and open
+    // upvalues move along with it, any other pointer into the stack is left dangling
+    bool growStack(std::size_t size);
+    object::UpvaluePtr captureUpvalue(object::Value *local);
+    void closeUpvalues(object::Value *last);
+
+    void runtimeError(const std::string &message);
+
+    std::vector<object::Value> stack;
+    object::Value *stackTop = nullptr;
+    // Only the first frameCount are in use, the vector grows as calls nest deeper
+    std::vector<CallFrame> frames;
+    std::size_t frameCount = 0;
+
+    object::SymbolMap<object::Value> globals;
+    object::UpvaluePtr openUpvalues = nullptr;
+};
+
+}  // namespace draft
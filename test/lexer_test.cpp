@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <lexer.h>
+#include <scan.h>
+
+using namespace draft;
+
+namespace {
+
+std::vector<std::tuple<Token::Kind, std::string, std::size_t>> tokensOf(std::string_view source)
+{
+    std::vector<std::tuple<Token::Kind, std::string, std::size_t>> result;
+    for (const Token &token : Lexer{source}.scanTokens()) {
+        result.emplace_back(token.kind, std::string{token.lexeme()}, token.line);
+    }
+    return result;
+}
+
+}  // namespace
+
+TEST(LexerTest, scannersAgree)
+{
+    // Runs of every kind shorter and longer than a vector, and ones cut off by the end of the source
+    std::string source = "var a_long_identifier_that_spans_more_than_32_bytes = \"a string\n\n over lines\";\n"
+                         "   \t\r\n\n\n                                          \n// comment \xd3\x80 to the end of the line\n"
+                         "class Q9 { init() { this.x_1 = 'single quoted, \"with\" a\nnewline'; } }\n"
+                         "print 12.5 >= x or !y; // " +
+                         std::string(70, 'c') + "\n" + std::string(100, ' ') + "\n" + std::string(40, 'z');
+    std::string_view original = scan::scanner().name;
+    ASSERT_TRUE(scan::choose("scalar"));
+    auto expected = tokensOf(source);
+    ASSERT_EQ(std::get<2>(expected.back()), std::ranges::count(source, '\n') + 1u);
+
+    for (const char *name : {"sse2", "avx2"}) {
+        if (!scan::choose(name)) {
+            continue;
+        }
+        // Starting from every offset moves the runs across the vectors
+        for (std::size_t offset = 0; offset < 32; ++offset) {
+            std::string shifted = std::string(offset, ' ') + source;
+            EXPECT_EQ(tokensOf(shifted), expected) << name << " at offset " << offset;
+        }
+    }
+    ASSERT_TRUE(scan::choose(original));
+}
+
+TEST(LexerTest, keywords)
+{
+    std::string source;
+    std::vector<Token::Kind> expected;
+    // Each keyword, then with a character before and after it
+#define KEYWORD(kind, name)                 \
+    source += name " x" name " " name "s "; \
+    expected.insert(expected.end(), {Token::Kind::kind, Token::Kind::Identifier, Token::Kind::Identifier});
+#include "token.def"
+    // Sharing the first and last characters and the length with a keyword, or in another case
+    source += "fur tree Class IF a _ ";
+    expected.insert(expected.end(), 6, Token::Kind::Identifier);
+    expected.push_back(Token::Kind::EndOfFile);
+
+    std::vector<Token::Kind> kinds;
+    for (const Token &token : Lexer{source}.scanTokens()) {
+        kinds.push_back(token.kind);
+    }
+    ASSERT_EQ(kinds, expected);
+}
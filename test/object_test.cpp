@@ -0,0 +1,204 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <limits>
+
+#include <environment.h>
+#include <heap.h>
+#include <obj_shape.h>
+#include <object.h>
+
+using namespace draft;
+
+TEST(ValueTest, size)
+{
+    ASSERT_EQ(8, sizeof(object::Value));
+}
+
+TEST(ValueTest, numbers)
+{
+    for (double number : {0.0, -0.0, 1.5, -42.0, std::numeric_limits<double>::infinity(),
+                          std::numeric_limits<double>::lowest(), std::numeric_limits<double>::denorm_min()}) {
+        object::Value value{number};
+        ASSERT_TRUE(value.isNumber());
+        ASSERT_FALSE(value.isNil() or value.isBool() or value.isObj());
+        ASSERT_EQ(number, value.asNumber());
+    }
+
+    object::Value nan{std::nan("")};
+    ASSERT_TRUE(nan.isNumber());
+    ASSERT_TRUE(std::isnan(nan.asNumber()));
+    ASSERT_FALSE(object::isEqual(nan, nan));
+
+    object::Value zeroByZero{0.0 / std::numeric_limits<double>::quiet_NaN()};
+    ASSERT_TRUE(zeroByZero.isNumber());
+}
+
+TEST(ValueTest, singletons)
+{
+    object::Value nil;
+    ASSERT_TRUE(nil.isNil());
+    ASSERT_FALSE(object::isTruthy(nil));
+
+    object::Value yes{true};
+    object::Value no{false};
+    ASSERT_TRUE(yes.isBool() and no.isBool());
+    ASSERT_TRUE(yes.asBool());
+    ASSERT_FALSE(no.asBool());
+    ASSERT_FALSE(object::isTruthy(no));
+    ASSERT_FALSE(object::isEqual(nil, no));
+    ASSERT_TRUE(object::isTruthy(object::Value{0.0}));
+}
+
+TEST(ValueTest, strings)
+{
+    object::Value a = object::intern("draft");
+    object::Value b = object::intern(std::string{"dr"} + "aft");
+    ASSERT_TRUE(a.isString());
+    ASSERT_FALSE(a.isNumber() or a.isCallable() or a.isInstance());
+    ASSERT_EQ("draft", object::obj2str(a));
+    ASSERT_EQ(a.asString(), b.asString());
+    ASSERT_TRUE(object::isEqual(a, b));
+    ASSERT_FALSE(object::isEqual(a, object::intern("other")));
+}
+
+TEST(ValueTest, symbols)
+{
+    object::Roots roots;
+    object::SymbolMap<int> map;
+    for (auto name : {"x", "y"}) {
+        object::StringPtr symbol = object::intern(name);
+        roots.add(symbol);
+        map.emplace(symbol, static_cast<int>(map.size()) + 1);
+    }
+    ASSERT_EQ(1, map.find(object::intern("x"))->second);
+    ASSERT_EQ(2, map.find(object::intern("y"))->second);
+    ASSERT_FALSE(map.contains(object::intern("z")));
+    ASSERT_EQ(object::symbols().init, object::intern("init"));
+}
+
+namespace {
+
+// Reports its own destruction
+class Probe : public object::Obj {
+public:
+    explicit Probe(bool &destroyed)
+        : Obj{Kind::Instance}
+        , destroyed{destroyed}
+    {
+    }
+    ~Probe() override
+    {
+        destroyed = true;
+    }
+
+private:
+    bool &destroyed;
+};
+
+}  // namespace
+
+TEST(HeapTest, unreachable)
+{
+    bool destroyed = false;
+    object::make<Probe>(destroyed);
+    object::heap().collect();
+    ASSERT_TRUE(destroyed);
+
+    // The intern table forgets strings that were freed
+    std::string chars = "transient";
+    object::intern(chars);
+    object::heap().collect();
+    ASSERT_EQ(chars, object::intern(chars)->chars);
+}
+
+TEST(HeapTest, roots)
+{
+    bool destroyed = false;
+    {
+        object::Roots roots;
+        roots.add(object::make<Probe>(destroyed));
+        object::heap().collect();
+        ASSERT_FALSE(destroyed);
+    }
+    object::heap().collect();
+    ASSERT_TRUE(destroyed);
+}
+
+TEST(HeapTest, tracing)
+{
+    bool destroyed = false;
+    {
+        object::Roots roots;
+        auto *outer = object::make<Environment>();
+        roots.add(outer);
+        auto *inner = object::make<Environment>();
+        outer->define(inner);
+        inner->define(object::make<Probe>(destroyed));
+        object::heap().collect();
+        ASSERT_FALSE(destroyed);
+        ASSERT_TRUE(outer->get(0).isObj());
+    }
+    object::heap().collect();
+    ASSERT_TRUE(destroyed);
+}
+
+TEST(HeapTest, cycles)
+{
+    auto before = object::heap().stats();
+    {
+        // Two frames referring to each other, reachable from nowhere else
+        auto *first = object::make<Environment>();
+        auto *second = object::make<Environment>();
+        first->define(second);
+        second->define(first);
+    }
+    object::heap().collect();
+    auto after = object::heap().stats();
+    ASSERT_GT(after.collections, before.collections);
+    ASSERT_GE(after.objectsFreed - before.objectsFreed, 2u);
+    ASSERT_LE(object::heap().bytesInUse(), after.peakBytes);
+}
+
+TEST(ShapeTest, transitions)
+{
+    object::Roots roots;
+    auto *root = object::make<object::Shape>();
+    roots.add(root);
+    auto x = object::intern("x");
+    auto y = object::intern("y");
+    roots.add(x);
+    roots.add(y);
+
+    auto *withX = root->transition(x);
+    ASSERT_EQ(withX, root->transition(x));
+    ASSERT_EQ(1u, withX->size());
+    ASSERT_EQ(0u, withX->find(x));
+    ASSERT_FALSE(withX->find(y));
+    ASSERT_FALSE(root->find(x));
+
+    // The order fields are added in matters
+    auto *xy = withX->transition(y);
+    auto *yx = root->transition(y)->transition(x);
+    ASSERT_NE(xy, yx);
+    ASSERT_EQ(1u, xy->find(y));
+    ASSERT_EQ(0u, yx->find(y));
+}
+
+TEST(ShapeTest, manyFields)
+{
+    object::Roots roots;
+    auto *shape = object::make<object::Shape>();
+    roots.add(shape);
+    std::vector<object::StringPtr> names;
+    for (int i = 0; i < 20; ++i) {
+        names.push_back(object::intern("field" + std::to_string(i)));
+        roots.add(names.back());
+        shape = shape->transition(names.back());
+    }
+    ASSERT_EQ(20u, shape->size());
+    for (std::uint32_t i = 0; i < names.size(); ++i) {
+        ASSERT_EQ(i, shape->find(names[i]));
+    }
+    ASSERT_FALSE(shape->find(object::intern("other")));
+}
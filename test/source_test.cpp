@@ -1,25 +1,31 @@
 #include <gtest/gtest.h>
 
+#include <cstdio>
+#include <fstream>
+
 #include <source.h>
 
 using namespace draft;
 
-TEST(SourceTest, toStdString)
+TEST(SourceTest, charAt)
 {
-    std::u32string utf32{U"Ӏ"};  // U+04C0
-    ASSERT_EQ(1, utf32.size());
-
-    std::string utf8 = Source::toStdString(utf32);
+    std::string utf8{"Ӏ"};  // U+04C0
     ASSERT_EQ(2, utf8.size());
+
+    Source source{utf8};
+    ASSERT_EQ(U'Ӏ', source.charAt(0));
+    // Not the start of a code point
+    ASSERT_EQ(U'\uFFFD', source.charAt(1));
 }
 
-TEST(SourceTest, fromStdString)
+TEST(SourceTest, lineAt)
 {
-    std::string utf8{"Ӏ"};  // U+04C0
-    ASSERT_EQ(2, utf8.size());
-
-    std::u32string utf32 = Source::fromStdString(utf8);
-    ASSERT_EQ(1, utf32.size());
+    Source source{"var a;\n// Ӏ\n\nprint a;"};
+    ASSERT_EQ("var a;\n", source.lineAt(1));
+    ASSERT_EQ("// Ӏ\n", source.lineAt(2));
+    ASSERT_EQ("\n", source.lineAt(3));
+    ASSERT_EQ("print a;", source.lineAt(4));
+    ASSERT_EQ("", source.lineAt(5));
 }
 
 TEST(Source, positionAt)
@@ -48,3 +54,42 @@ print "world";
     ASSERT_EQ(2, pos2_8.line);
     ASSERT_EQ(8, pos2_8.column);
 }
+
+TEST(Source, columnsCountCodePoints)
+{
+    Source source{"\"ӀӀ\" + x;\n"};
+
+    Source::Offset offset{6};
+    ASSERT_EQ(U' ', source.charAt(offset));
+    Source::Position pos = source.positionAt(offset);
+    ASSERT_EQ(1, pos.line);
+    ASSERT_EQ(5, pos.column);
+}
+
+TEST(Source, load)
+{
+    std::string path = ::testing::TempDir() + "source_test_load.lox";
+    std::string code = "print \"Ӏ\";\nprint 2;\n";
+    {
+        std::ofstream file{path, std::ios::binary};
+        file << code;
+    }
+    std::optional<Source> source = Source::load(path);
+    ASSERT_TRUE(source);
+    ASSERT_EQ(code, source->text());
+    ASSERT_EQ("print 2;\n", source->lineAt(2));
+
+    // Too empty to be mapped, read instead
+    std::ofstream{path, std::ios::binary | std::ios::trunc}.close();
+    source = Source::load(path);
+    ASSERT_TRUE(source);
+    ASSERT_EQ("", source->text());
+
+    // Has no size to map
+    source = Source::load("/proc/self/status");
+    ASSERT_TRUE(source);
+    ASSERT_TRUE(source->text().starts_with("Name:"));
+
+    std::remove(path.c_str());
+    ASSERT_FALSE(Source::load(path));
+}
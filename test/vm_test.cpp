@@ -0,0 +1,687 @@
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+#include <compiler.h>
+#include <driver.h>
+#include <heap.h>
+#include <inline_cache.h>
+#include <lexer.h>
+#include <parser.h>
+#include <register_compiler.h>
+
+using namespace draft;
+
+namespace {
+
+std::string runWith(Driver::Engine engine, const std::string &code)
+{
+    Driver::engine = engine;
+    std::stringstream out;
+    std::streambuf *previous = std::cout.rdbuf(out.rdbuf());
+    Driver::run(code);
+    std::cout.rdbuf(previous);
+    Driver::engine = Driver::Engine::Stack;
+    return out.str();
+}
+
+}  // namespace
+
+TEST(VMTest, disassemble)
+{
+    Lexer lexer{"print 1 + 2;"};
+    std::vector<Token> tokens = lexer.scanTokens();
+    memory::Arena arena;
+    Parser parser{tokens, arena};
+    std::vector<Stmt *> statements = parser.parse();
+
+    Compiler compiler;
+    object::PrototypePtr script = compiler.compile(statements);
+    ASSERT_EQ(script->chunk.disassemble("script"),
+              "== script ==\n"
+              "0 [line 1] Constant 0 '1.000000'\n"
+              "3 [line 1] Constant 1 '2.000000'\n"
+              "6 [line 1] Add\n"
+              "7 [line 1] Print\n"
+              "8 [line 1] Nil\n"
+              "9 [line 1] Return\n");
+}
+
+TEST(VMTest, disassembleRegisters)
+{
+    Lexer lexer{"fun f(a) { var b = a * 2; return b + a; }"};
+    std::vector<Token> tokens = lexer.scanTokens();
+    memory::Arena arena;
+    Parser parser{tokens, arena};
+    std::vector<Stmt *> statements = parser.parse();
+
+    RegisterCompiler compiler;
+    object::PrototypePtr script = compiler.compile(statements);
+    ASSERT_EQ(script->chunk.prototypes.at(0)->chunk.disassembleRegisters("f"),
+              "== f ==\n"
+              "0 [line 1] Multiply r2 r1 '2.000000'\n"
+              "1 [line 1] Add r3 r2 r1\n"
+              "2 [line 1] Return r3\n"
+              "3 [line 1] Nil r3\n"
+              "4 [line 1] Return r3\n");
+}
+
+TEST(VMTest, closures)
+{
+    std::string code{R"(
+fun makeCounter() {
+    var i = 0;
+    fun count() {
+        i = i + 1;
+        return i;
+    }
+    return count;
+}
+var counter = makeCounter();
+counter();
+print counter();
+)"};
+    std::string output = runWith(Driver::Engine::Stack, code);
+    ASSERT_TRUE(output.ends_with("2.000000\n"));
+    ASSERT_EQ(output, runWith(Driver::Engine::Tree, code));
+}
+
+TEST(VMTest, capturedVariables)
+{
+    std::string code{R"(
+fun makePair() {
+    var shared = 0;
+    fun inc() { shared = shared + 1; return shared; }
+    fun get() { return shared; }
+    shared = 10;
+    inc();
+    return fun2(inc, get);
+}
+fun fun2(a, b) { a(); return b; }
+print makePair()();
+
+fun adder(n) {
+    fun add(x) { n = n + x; return n; }
+    return add;
+}
+var a = adder(5);
+a(1);
+print a(2);
+
+fun outer(x) {
+    fun middle() {
+        fun inner() { return x; }
+        return inner;
+    }
+    return middle();
+}
+print outer("deep")();
+
+fun countdown(n) {
+    fun step(k) {
+        if (k <= 0) return "done";
+        return step(k - 1);
+    }
+    return step(n);
+}
+print countdown(5);
+
+{
+    var fns = nil;
+    for (var i = 0; i < 3; i = i + 1) {
+        var j = i;
+        fun show() { return j; }
+        if (i == 1) fns = show;
+    }
+    print fns();
+}
+
+class Base {
+    greet() { return "base"; }
+}
+class Derived < Base {
+    greet() {
+        fun later() { return super.greet() + "+" + this.name; }
+        return later;
+    }
+    make() { return Derived(); }
+    init() { this.name = "derived"; }
+}
+print Derived().greet()();
+print Derived().make().name;
+
+fun sibling() {
+    var v = 1;
+    {
+        var w = 2;
+        fun both() { return v + w; }
+        v = 10;
+        print both();
+    }
+}
+sibling();
+
+class Counter {
+    init() { this.n = 0; }
+    incrementer() {
+        fun inc() { this.n = this.n + 1; return this.n; }
+        return inc;
+    }
+}
+var c = Counter();
+var inc = c.incrementer();
+inc(); inc();
+print c.n;
+fun paramLater(p) {
+    p = p + 1;
+    fun get() { return p; }
+    p = p * 10;
+    return get;
+}
+print paramLater(1)();
+)"};
+    std::string output = runWith(Driver::Engine::Stack, code);
+    ASSERT_TRUE(output.ends_with("12.000000\n8.000000\ndeep\ndone\n1.000000\nbase+derived\nderived\n"
+                                 "12.000000\n2.000000\n20.000000\n"));
+    ASSERT_EQ(output, runWith(Driver::Engine::Tree, code));
+}
+
+TEST(VMTest, blockScopes)
+{
+    std::string code{R"(
+{
+    var a = "outer";
+    {
+        var a = "inner";
+        print a;
+    }
+    print a;
+    var b = "b";
+    print b;
+}
+fun f() {
+    var x = 1;
+    {
+        var y = 2;
+        {
+            var z = 3;
+            print x + y + z;
+        }
+        var w = 4;
+        print w + y;
+    }
+    var v = 5;
+    print v + x;
+}
+f();
+{
+    class A {
+        m() { return "A"; }
+    }
+    class B < A {
+        m() { return super.m() + "B"; }
+    }
+    print B().m();
+}
+)"};
+    std::string output = runWith(Driver::Engine::Stack, code);
+    ASSERT_TRUE(output.ends_with("inner\nouter\nb\n6.000000\n6.000000\n6.000000\nAB\n"));
+    ASSERT_EQ(output, runWith(Driver::Engine::Tree, code));
+}
+
+TEST(VMTest, loopsDoNotAllocate)
+{
+    std::string code{R"(
+fun sum(n) {
+    var total = 0;
+    for (var i = 0; i < n; i = i + 1) {
+        var square = i * i;
+        {
+            var half = square / 2;
+            total = total + half;
+        }
+    }
+    return total;
+}
+print sum(10000);
+)"};
+    auto before = object::heap().stats().objectsAllocated;
+    ASSERT_TRUE(runWith(Driver::Engine::Tree, code).ends_with("\n166641667500.000000\n"));
+    // Interned names and the function, but nothing per iteration
+    ASSERT_LT(object::heap().stats().objectsAllocated - before, 100u);
+}
+
+TEST(VMTest, classes)
+{
+    std::string code{R"(
+class Base {
+    init(name) { this.name = name; }
+    greet() { return "hello " + this.name; }
+}
+class Derived < Base {
+    greet() { return super.greet() + "!"; }
+}
+print Derived("vm").greet();
+)"};
+    std::string output = runWith(Driver::Engine::Stack, code);
+    ASSERT_TRUE(output.ends_with("hello vm!\n"));
+    ASSERT_EQ(output, runWith(Driver::Engine::Tree, code));
+}
+
+TEST(VMTest, recursion)
+{
+    std::string code{R"(
+fun fib(n) {
+    if (n < 2) return n;
+    return fib(n - 1) + fib(n - 2);
+}
+print fib(15);
+)"};
+    std::string output = runWith(Driver::Engine::Stack, code);
+    ASSERT_TRUE(output.ends_with("610.000000\n"));
+    ASSERT_EQ(output, runWith(Driver::Engine::Tree, code));
+}
+
+TEST(VMTest, returnFromLoops)
+{
+    std::string code{R"(
+fun nested(limit) {
+    for (var i = 0; i < 10; i = i + 1) {
+        {
+            var j = i * 2;
+            if (j >= limit) return j;
+        }
+    }
+    return "none";
+}
+fun first(limit) {
+    var i = 0;
+    while (i < 10) {
+        if (i == limit) {
+            return i;
+        }
+        i = i + 1;
+    }
+    return "none";
+}
+class Box {
+    init(value) {
+        this.value = value;
+        if (value) return;
+        this.value = "empty";
+    }
+}
+print first(3);
+print first(20);
+print Box(nil).value;
+print Box(1).value;
+print first(first(2) + 1);
+print nested(5);
+print nested(50);
+)"};
+    std::string output = runWith(Driver::Engine::Stack, code);
+    ASSERT_TRUE(output.ends_with("3.000000\nnone\nempty\n1.000000\n3.000000\n6.000000\nnone\n"));
+    ASSERT_EQ(output, runWith(Driver::Engine::Tree, code));
+}
+
+TEST(VMTest, collectorStress)
+{
+    std::string code{R"(
+class Node {
+    init(value, next) {
+        this.value = value;
+        this.next = next;
+    }
+    describe() { return "node " + this.value; }
+}
+class Tagged < Node {
+    describe() { return super.describe() + " tagged"; }
+}
+fun adder(n) {
+    fun add(x) { return x + n; }
+    return add;
+}
+var list = nil;
+for (var i = 0; i < 20; i = i + 1) {
+    var label = "n" + "" + "x";
+    list = Tagged(label, list);
+}
+var describe = list.describe;
+print describe();
+var add = adder("!");
+print add(list.next.describe() + "?");
+var count = 0;
+while (list != nil) {
+    count = count + 1;
+    list = list.next;
+}
+print count;
+)"};
+    object::Heap::Options options;
+    options.stress = true;
+    object::heap().configure(options);
+    auto collections = object::heap().stats().collections;
+    std::string output = runWith(Driver::Engine::Stack, code);
+    std::string tree = runWith(Driver::Engine::Tree, code);
+    std::string registers = runWith(Driver::Engine::Register, code);
+    object::heap().configure(object::Heap::Options{});
+
+    ASSERT_GT(object::heap().stats().collections, collections);
+    ASSERT_TRUE(output.ends_with("node nx tagged\nnode nx tagged?!\n20.000000\n"));
+    ASSERT_EQ(output, tree);
+    ASSERT_EQ(output, registers);
+}
+
+TEST(VMTest, inlineCaches)
+{
+    std::string code{R"(
+class Point {
+    init(x, y) {
+        this.x = x;
+        this.y = y;
+    }
+    sum() { return this.x + this.y; }
+}
+var total = 0;
+for (var i = 0; i < 100; i = i + 1) {
+    var p = Point(i, 1);
+    total = total + p.sum();
+}
+print total;
+)"};
+    for (auto engine : {Driver::Engine::Stack, Driver::Engine::Register, Driver::Engine::Tree}) {
+        auto before = object::InlineCache::stats();
+        ASSERT_TRUE(runWith(engine, code).ends_with("\n5050.000000\n"));
+        auto after = object::InlineCache::stats();
+        // Every site misses once, then keeps hitting the same shape. The tree-walker loads the fields
+        // through specialized nodes instead
+        ASSERT_LE(after.misses - before.misses, 10u);
+        ASSERT_GE(after.hits - before.hits, engine == Driver::Engine::Tree ? 300u : 500u);
+        ASSERT_EQ(after.polymorphic, before.polymorphic);
+    }
+}
+
+TEST(VMTest, methodCallsDoNotAllocate)
+{
+    std::string code{R"(
+class Counter {
+    init() { this.count = 0; }
+    add(n) {
+        this.count = this.count + n;
+        return this;
+    }
+}
+var counter = Counter();
+for (var i = 0; i < 10000; i = i + 1) {
+    counter.add(1).add(2);
+}
+print counter.count;
+)"};
+    for (auto engine : {Driver::Engine::Stack, Driver::Engine::Register, Driver::Engine::Tree}) {
+        auto before = object::heap().stats().objectsAllocated;
+        ASSERT_TRUE(runWith(engine, code).ends_with("\n30000.000000\n"));
+        // The methods are invoked on their receivers rather than bound first
+        ASSERT_LT(object::heap().stats().objectsAllocated - before, 100u);
+    }
+}
+
+TEST(VMTest, invokedProperties)
+{
+    std::string code{R"(
+class Box {
+    init(value) { this.value = value; }
+    get() { return this.value; }
+    again() { return this.init(this.value + 1); }
+}
+fun twice(n) { return n * 2; }
+var box = Box(1);
+print box.get();
+print box.again().get();
+box.get = twice;
+print box.get(5);
+box.make = Box;
+print box.make(7).get();
+var method = Box(9).get;
+print method();
+print box.value(1);
+)"};
+    std::string output = runWith(Driver::Engine::Stack, code);
+    ASSERT_TRUE(output.ends_with("\n1.000000\n2.000000\n10.000000\n7.000000\n9.000000\n")) << output;
+    ASSERT_EQ(output, runWith(Driver::Engine::Register, code));
+    ASSERT_EQ(output, runWith(Driver::Engine::Tree, code));
+}
+
+TEST(VMTest, polymorphicCaches)
+{
+    std::string code{R"(
+class A { name() { return "a"; } }
+class B { name() { return "b"; } }
+fun describe(obj) { return obj.name(); }
+var out = "";
+for (var i = 0; i < 3; i = i + 1) {
+    out = out + describe(A()) + describe(B());
+}
+class C {}
+fun nameC() { return "c"; }
+fun nameD() { return "d"; }
+var c = C();
+c.name = nameC;
+for (var i = 0; i < 2; i = i + 1) {
+    var d = C();
+    d.other = 1;
+    d.name = nameD;
+    out = out + describe(c) + describe(d);
+}
+print out;
+)"};
+    for (auto engine : {Driver::Engine::Stack, Driver::Engine::Register, Driver::Engine::Tree}) {
+        auto before = object::InlineCache::stats();
+        ASSERT_TRUE(runWith(engine, code).ends_with("\nabababcdcd\n"));
+        auto after = object::InlineCache::stats();
+        // The site in describe() has seen four shapes, of which two are methods and two fields
+        ASSERT_GE(after.polymorphic - before.polymorphic, 1u);
+        ASSERT_EQ(after.megamorphic, before.megamorphic);
+    }
+}
+
+TEST(VMTest, nodeSpecialization)
+{
+    // Every site first specializes on what it sees, then has its guard fail
+    std::string code{R"(
+fun add(a, b) { return a + b; }
+fun less(a, b) { return a < b; }
+fun same(a, b) { return a == b; }
+print add(1, 2);
+print add("a", "b");
+print add(3, 4);
+print same(1, 1);
+print same(nil, nil);
+print same(1, "1");
+class A { init() { this.x = "a"; } }
+class B { init() { this.y = 0; this.x = "b"; } }
+fun getX(obj) { return obj.x; }
+print getX(A());
+print getX(B());
+print getX(A());
+class C { init(v) { this.v = v; } }
+fun one(a) { return a; }
+fun callWith1(f) { return f(1); }
+print callWith1(one);
+print callWith1(C).v;
+print less(1, 2);
+print less("a", 2);
+)"};
+    std::string output = runWith(Driver::Engine::Tree, code);
+    ASSERT_TRUE(output.ends_with(
+        "\n3.000000\nab\n7.000000\ntrue\ntrue\nfalse\na\nb\na\n1.000000\n1.000000\ntrue\n"));
+    ASSERT_EQ(output, runWith(Driver::Engine::Stack, code));
+
+    // A call site specialized on one function must check the arity of another
+    std::string arity{R"(
+fun one(a) { return a; }
+fun two(a, b) { return a + b; }
+fun callWith1(f) { return f(1); }
+callWith1(one);
+callWith1(two);
+print "unreachable";
+)"};
+    output = runWith(Driver::Engine::Tree, arity);
+    ASSERT_FALSE(output.ends_with("\nunreachable\n"));
+}
+
+TEST(VMTest, deepRecursion)
+{
+    // Far deeper than the native stack would allow if each call took native frames
+    std::string code{R"(
+fun depth(n) {
+    if (n == 0) return 0;
+    return depth(n - 1) + 1;
+}
+class Node {
+    init(n) {
+        if (n > 0) this.next = Node(n - 1);
+    }
+}
+var node = Node(20000);
+print depth(90000);
+)"};
+    for (Driver::Engine engine : {Driver::Engine::Stack, Driver::Engine::Register, Driver::Engine::Tree}) {
+        ASSERT_TRUE(runWith(engine, code).ends_with("\n90000.000000\n"));
+
+        // Past the limit it is an error rather than a crash, and the engine is ready to run again
+        Driver::maxDepth = 1000;
+        std::string output = runWith(engine, "fun f(n) { if (n == 5000) return 0; return f(n + 1) + 1; }\nprint f(0);\n");
+        Driver::maxDepth = Interpreter::DefaultMaxDepth;
+        ASSERT_FALSE(output.ends_with("\n5000.000000\n"));
+        std::string again = runWith(engine, "fun g(n) { if (n > 0) return g(n - 1); return n; }\nprint g(3);\n");
+        ASSERT_TRUE(again.ends_with("\n0.000000\n"));
+    }
+}
+
+TEST(VMTest, deepStacks)
+{
+    // Each call keeps hundreds of values on the stack, and calls nest deeper than a fixed array of
+    // frames would hold. Registers are numbered in a byte, so their functions nest less
+    auto program = [](int levels, int calls) {
+        std::string nested = "f(n - 1)";
+        for (int i = 0; i < levels; i++) {
+            nested = "1 + (" + nested + ")";
+        }
+        return "fun f(n) {\n    if (n == 0) return 0;\n    return " + nested + ";\n}\n"
+               "fun g(n) {\n    if (n == 0) return 0;\n    return g(n - 1) + 1;\n}\n"
+               "print f(" + std::to_string(calls) + ");\nprint g(1000);\n";
+    };
+    std::string code = program(600, 250);
+    for (Driver::Engine engine : {Driver::Engine::Stack, Driver::Engine::Tree}) {
+        std::string output = runWith(engine, code);
+        ASSERT_TRUE(output.ends_with("\n150000.000000\n1000.000000\n")) << output;
+    }
+    std::string output = runWith(Driver::Engine::Register, program(200, 1000));
+    ASSERT_TRUE(output.ends_with("\n200000.000000\n1000.000000\n")) << output;
+}
+
+TEST(VMTest, declarationsOutliveTheirLine)
+{
+    // Like lines of the REPL: the source and syntax tree of the first run are gone by the second
+    for (Driver::Engine engine : {Driver::Engine::Stack, Driver::Engine::Register, Driver::Engine::Tree}) {
+        runWith(engine, std::string{"fun inc(a) { return a + 1; }\nclass Twice { of(b) { return b * 2; } }\n"});
+        std::string output = runWith(engine, std::string{"print Twice().of(inc(2));\n"});
+        ASSERT_TRUE(output.ends_with("\n6.000000\n")) << output;
+    }
+}
+
+TEST(VMTest, upvaluesOutliveRuntimeErrors)
+{
+    // A runtime error drops the stack, a closure made before it keeps the value it captured
+    // rather than whatever later runs leave in the slot
+    std::string declarations{R"(
+var g = nil;
+fun f() {
+    var x = "captured";
+    fun h() { return x; }
+    g = h;
+    nil();
+}
+f();
+)"};
+    std::string later{R"(
+fun junk() { var s = "a" + "b"; return 0; }
+junk();
+var pad = "c" + "d";
+print g();
+)"};
+    for (Driver::Engine engine : {Driver::Engine::Stack, Driver::Engine::Register, Driver::Engine::Tree}) {
+        runWith(engine, declarations);
+        std::string output = runWith(engine, later);
+        ASSERT_TRUE(output.ends_with("\ncaptured\n")) << output;
+    }
+}
+
+TEST(VMTest, tailCalls)
+{
+    // A million calls deep, far past every engine's limit on nested calls, unless each call in tail
+    // position takes over the frame of its caller
+    std::string code{R"(
+fun count(n, acc) {
+    if (n == 0) return acc;
+    return count(n - 1, acc + 1);
+}
+fun isEven(n) {
+    if (n == 0) return true;
+    return isOdd(n - 1);
+}
+fun isOdd(n) {
+    if (n == 0) return false;
+    return isEven(n - 1);
+}
+class Walker {
+    walk(n) {
+        if (n == 0) return this.name;
+        return (this.walk(n - 1));
+    }
+}
+fun capture(n, f) {
+    if (n == 0) return f();
+    var saved = n;
+    fun get() { return saved; }
+    if (n == 3) return capture(n - 1, get);
+    return capture(n - 1, f);
+}
+fun native() { return clock(); }
+fun construct() { return Walker(); }
+var walker = Walker();
+walker.name = "walked";
+print count(1000000, 0);
+print isEven(1000001);
+print walker.walk(1000000);
+print capture(10, nil);
+print native() > 0;
+print construct();
+print count(1);
+)"};
+    for (Driver::Engine engine : {Driver::Engine::Stack, Driver::Engine::Register, Driver::Engine::Tree}) {
+        std::string output = runWith(engine, code);
+        ASSERT_TRUE(output.ends_with("\n1000000.000000\nfalse\nwalked\n3.000000\ntrue\ninstance\n")) << output;
+    }
+}
+
+TEST(VMTest, registerEvaluationOrder)
+{
+    // Locals are operands in place, so a later operand that assigns one must not change the earlier
+    std::string code{R"(
+fun f() {
+    var a = 1;
+    fun set() { a = 10; return 0; }
+    var b = 2;
+    var x = nil;
+    x = b or x;
+    print a + set();
+    print b + (b = 5);
+    print x;
+}
+f();
+)"};
+    std::string output = runWith(Driver::Engine::Register, code);
+    ASSERT_TRUE(output.ends_with("\n1.000000\n7.000000\n2.000000\n"));
+    ASSERT_EQ(output, runWith(Driver::Engine::Tree, code));
+}